@@ -1,9 +1,92 @@
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <sys/prctl.h>
 #include "application.h"
+#include "cgroup.h"
 #include "constants.h"
 
+namespace {
+    // close enough to the exec of cm to report how long startup took
+    const auto process_start = std::chrono::steady_clock::now();
+
+    std::string format_ms(std::chrono::steady_clock::duration d) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%.2f ms", std::chrono::duration<double, std::milli>(d).count());
+        return buf;
+    }
+
+    std::string listener_key(const cm::config_map::configured_application &app, const std::string &address) {
+        return cm::listen_socket::is_unix(address) ? address : app.name + " " + address;
+    }
+}
+
 cm::application::application(std::shared_ptr<cm::config_map> map, std::shared_ptr<cm::logger> log)
-        : map(map), kill_timer(ios), signal_set(ios), completed_apps(0), log(log), shutdown_running(false) {
+        : map(map), control(ios), schedules(control, std::chrono::seconds(1)), kill_timer(ios), suppressed_timer(ios), latency_timer(ios), signal_set(ios),
+          completed_apps(0), log(log), shutdown_running(false) {
     setup_signal_set();
+
+    // as PID 1 the kernel hands cm every orphan of the container anyway. as child subreaper cm gets
+    // the orphans of its apps even when it runs under another init
+    bool orphans = map->orphans == config_map::orphan_mode::SUBREAPER ||
+                   (map->orphans == config_map::orphan_mode::AUTO && ::getpid() == 1);
+    if (map->orphans == config_map::orphan_mode::SUBREAPER && ::prctl(PR_SET_CHILD_SUBREAPER, 1) == -1) {
+        log->err(app_name, std::string("Can't become child subreaper: ") + std::strerror(errno));
+        orphans = false;
+    }
+
+    reaper = std::make_unique<cm::reaper>(ios, orphans);
+    if (orphans)
+        log->err(app_name, "Reaping orphaned processes");
+    if (!reaper->using_pidfd())
+        log->err(app_name, "pidfd not available, waiting for exits on SIGCHLD");
+
+    open_listeners(*map);
+
+    measuring_latency = map->latency_interval.total_milliseconds() > 0;
+
+    if (map->engine == config_map::io_engine::IO_URING) {
+        try {
+            ring = std::make_unique<uring>(ios);
+            log->err(app_name, "Using io_uring for app output");
+        } catch (const std::system_error &e) {
+            log->err(app_name, std::string("io_uring not available, falling back to epoll: ") + e.what());
+        }
+    }
+
+    if (map->resource_interval.total_milliseconds() > 0) {
+        sampler = std::make_unique<resource_sampler>(
+                ios, std::chrono::milliseconds(map->resource_interval.total_milliseconds()));
+
+        sampler->add_listener([this](const std::vector<resource_sampler::usage> &samples) {
+            for (const auto &u : samples)
+                this->log->log(logger::stream::STDERR, u.app, "resources", {
+                        {"pid",                  u.pid},
+                        {"cpu_percent",          u.cpu_percent},
+                        {"rss_bytes",            u.rss_bytes},
+                        {"read_bytes",           u.read_bytes},
+                        {"write_bytes",          u.write_bytes},
+                        {"voluntary_switches",   u.voluntary_switches},
+                        {"involuntary_switches", u.involuntary_switches}
+                });
+        });
+    }
+
+    if (!map->metrics_listen.empty()) {
+        metrics = std::make_unique<metrics_server>(ios, map->metrics_listen, [this](std::string &out) {
+            render_metrics(out);
+        });
+        log->err(app_name, "Serving metrics on " + map->metrics_listen);
+    }
+
+    if (!map->control_socket.empty()) {
+        ctl = std::make_unique<control_server>(ios, map->control_socket, [this](auto request, auto session) {
+            boost::asio::post(control, [this, request = std::move(request), session = std::move(session)]() {
+                control_handler(request, session);
+            });
+        });
+        log->err(app_name, "Accepting control commands on " + map->control_socket);
+    }
 }
 
 void cm::application::run() {
@@ -11,23 +94,96 @@ void cm::application::run() {
     setup_children();
     set_signal_handler();
 
-    ios.run();
+    if (!log_limits.empty())
+        start_suppressed_timer();
+
+    if (sampler)
+        sampler->start();
+
+    if (measuring_latency)
+        start_latency_timer();
+
+    unsigned threads = map->threads > 0 ? map->threads : cgroup::cpu_limit();
+    log->err(app_name, "Running event loop on " + std::to_string(threads) + " thread(s)");
+
+    std::vector<std::thread> workers;
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+
+    auto worker = [this, &failure, &failure_mutex]() {
+        try {
+            ios.run();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(failure_mutex);
+            if (!failure)
+                failure = std::current_exception();
+            ios.stop();
+        }
+    };
+
+    for (unsigned i = 1; i < threads; i++)
+        workers.emplace_back(worker);
+
+    worker();
+
+    for (auto &t : workers)
+        t.join();
+
+    if (failure)
+        std::rethrow_exception(failure);
+
+    // every line is read by now, once the writer caught up the histograms are complete
+    if (measuring_latency) {
+        log->flush();
+        report_latency(true);
+    }
 }
 
 void cm::application::kill_timeout_handler(const boost::system::error_code &ec) {
+
+    if (ec != boost::asio::error::operation_aborted)
+        trace::complete("kill delay", "", shutdown_begin, trace::clock::now());
+
     for (auto &it : children) {
         if (it.second->terminated())
             continue;
 
         log->err(app_name, "Forcibly terminating app " + it.first);
+        trace::instant("kill", it.first);
         it.second->kill();
     }
 }
 
 void cm::application::all_down_handler() {
+
+    // a removed app's exit and the shutdown tier it belonged to may both find all apps completed
+    if (all_down)
+        return;
+    all_down = true;
+
     log->err(app_name, "Shutdown complete");
+    if (shutdown_begin != trace::clock::time_point())
+        trace::complete("shutdown", "", shutdown_begin, trace::clock::now());
+    report_suppressed();
     signal_set.cancel();
     kill_timer.cancel();
+    suppressed_timer.cancel();
+    latency_timer.cancel();
+    if (sampler)
+        sampler->stop();
+    if (metrics)
+        metrics->stop();
+    if (ctl)
+        ctl->stop();
+    reaper->stop();
+
+    // every app was reaped, its output is in the pipes already. processes it left behind may hold
+    // them open, cm doesn't wait for their EOF
+    std::lock_guard<std::mutex> lock(children_mutex);
+    for (auto &it : children)
+        it.second->close_output();
+    for (auto &c : retired)
+        c->close_output();
 }
 
 void cm::application::shutdown_handler() {
@@ -38,6 +194,12 @@ void cm::application::shutdown_handler() {
     log->err(app_name, "Shutdown: total children: " + std::to_string(map->apps.size()) + ", completed: " +
                        std::to_string(completed_apps.load()));
 
+    if (first) {
+        shutdown_begin = trace::clock::now();
+        trace::instant("shutdown initiated", "");
+        cancel_pending();
+    }
+
     if (completed_apps.load() == map->apps.size()) {
         log->err(app_name, "All completed");
         all_down_handler();
@@ -48,20 +210,49 @@ void cm::application::shutdown_handler() {
 
         log->err(app_name, "Shutdown initiated");
 
-        for (auto &it : children) {
-            if (it.second->terminated())
-                continue;
+        // the deadline for the whole shutdown, stop-timeout of the apps only applies within it
+        kill_timer.expires_from_now(map->kill_delay);
 
-            log->err(app_name, "Terminating app " + it.first);
-            it.second->terminate();
-        }
+        kill_timer.async_wait(boost::asio::bind_executor(control, [this](auto &ec) { kill_timeout_handler(ec); }));
+    }
 
-        kill_timer.expires_from_now(map->kill_delay);
+    stop_next_tier();
+}
+
+void cm::application::stop_next_tier() {
+
+    // reverse startup order: an app is stopped once nothing depending on it runs anymore, so a
+    // backend keeps serving until its frontends are gone. apps which are free stop in parallel
+    for (const auto &app : map->apps) {
+        auto &s = supervised.at(app.name);
+        auto it = children.find(app.name);
 
-        kill_timer.async_wait([this](auto &ec) { kill_timeout_handler(ec); });
+        if (s.terminating || s.stop_requested || it == children.end() || it->second->terminated())
+            continue;
+
+        auto blocking = std::count_if(s.dependents.begin(), s.dependents.end(), [this](auto *dependent) {
+            return supervised.at(dependent->name).metrics.running.load();
+        });
+
+        if (blocking == 0)
+            terminate_app(app, s);
     }
 }
 
+void cm::application::terminate_app(const config_map::configured_application &app, supervision &s) {
+
+    log->err(app_name, "Terminating app " + app.name);
+    s.terminating = true;
+    s.terminated = trace::clock::now();
+    children.at(app.name)->terminate();
+
+    auto timeout = app.stop_timeout.total_milliseconds() > 0 ? app.stop_timeout : map->kill_delay;
+    s.stop_timer.expires_from_now(timeout);
+    s.stop_timer.async_wait(boost::asio::bind_executor(control, [this, app = hold(app)](auto &ec) {
+        stop_timeout_handler(*app, ec);
+    }));
+}
+
 void cm::application::signal_handler(const boost::system::error_code &ec, int signal_number) {
 
     auto ss = find_if(signals.begin(), signals.end(), [&](auto &s) { return s.first == signal_number; });
@@ -71,12 +262,17 @@ void cm::application::signal_handler(const boost::system::error_code &ec, int si
     else
         log->err(app_name, "Handling signal with number " + std::to_string(signal_number) + " (" + (*ss).second + ")");
 
+    trace::instant("signal", ss == signals.end() ? std::to_string(signal_number) : (*ss).second);
+
     switch (signal_number) {
         case SIGINT:
         case SIGQUIT:
         case SIGTERM:
             shutdown_handler();
             break;
+        case SIGHUP:
+            reload_handler();
+            break;
         default:
             break;
     }
@@ -89,64 +285,1227 @@ void cm::application::set_signal_handler() {
 
     log->err(app_name, "Setting signal handler");
 
-    signal_set.async_wait([this](auto &ec, int signo) { signal_handler(ec, signo); });
+    signal_set.async_wait(boost::asio::bind_executor(control, [this](auto &ec, int signo) {
+        signal_handler(ec, signo);
+    }));
 }
 
 void cm::application::setup_children() {
 
     log->err(app_name, "Starting applications");
 
-    for (const config_map::configured_application &app : map->apps) {
+    trace::span span("setup children");
+    auto begin = std::chrono::steady_clock::now();
+
+    for (const auto &app : map->apps)
+        supervised.try_emplace(app.name, app, ios);
+
+    // apps without dependencies start right away, the others once all their dependencies are ready
+    std::vector<const config_map::configured_application *> apps, scheduled;
+
+    for (const auto &app : map->apps) {
+        auto &s = supervised.at(app.name);
+        s.waiting = app.depends_on.size();
+        for (const auto &dependency : app.depends_on)
+            supervised.at(dependency).dependents.push_back(&app);
+
+        create_probe(app, s);
+
+        if (app.depends_on.empty())
+            (app.schedule ? scheduled : apps).push_back(&app);
+    }
+
+    for (const auto *app : scheduled)
+        schedule_app(*app);
+
+    // the first child creates the process group, the others join it
+    if (!apps.empty())
+        start_child(*apps.front());
+
+    std::atomic_size_t next(1);
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+
+    auto spawner = [this, &apps, &next, &failure, &failure_mutex]() {
+        for (std::size_t i = next++; i < apps.size(); i = next++) {
+            try {
+                start_child(*apps[i]);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(failure_mutex);
+                if (!failure)
+                    failure = std::current_exception();
+                next = apps.size();
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> spawners;
+    for (std::size_t i = 1; i < map->spawn_threads && i + 1 < apps.size(); i++)
+        spawners.emplace_back(spawner);
+
+    spawner();
+
+    for (auto &t : spawners)
+        t.join();
+
+    if (failure)
+        std::rethrow_exception(failure);
+
+    auto now = std::chrono::steady_clock::now();
+    std::string waiting;
+    if (apps.size() + scheduled.size() < map->apps.size())
+        waiting = ", " + std::to_string(map->apps.size() - apps.size() - scheduled.size()) +
+                  " waiting for their dependencies";
+
+    log->err(app_name, "Started " + std::to_string(apps.size()) + " applications in " + format_ms(now - begin) +
+                       ", " + format_ms(now - process_start) + " after start of " + app_name + waiting);
+}
+
+void cm::application::create_probe(const config_map::configured_application &app, supervision &s) {
+
+    retire_probe(s);
+
+    if (app.ready == config_map::ready_probe::NONE)
+        return;
+
+    s.probe = std::make_shared<readiness_probe>(app, ios, *reaper, [this, app = hold(app)](bool ready) {
+        boost::asio::post(control, [this, app, ready]() {
+            if (ready)
+                ready_handler(*app);
+            else
+                ready_timeout_handler(*app);
+        });
+    });
+}
+
+void cm::application::retire_probe(supervision &s) {
+
+    retired_probes.erase(std::remove_if(retired_probes.begin(), retired_probes.end(), [](auto &p) {
+        return p.use_count() == 1 && p->idle();
+    }), retired_probes.end());
+
+    if (s.probe) {
+        s.probe->cancel();
+        retired_probes.push_back(std::move(s.probe));
+    }
+}
+
+void cm::application::retire_child(const std::string &name) {
+    std::lock_guard<std::mutex> lock(children_mutex);
+
+    auto it = children.find(name);
+    if (it != children.end()) {
+        retired.push_back(std::move(it->second));
+        children.erase(it);
+    }
+
+    retired.erase(std::remove_if(retired.begin(), retired.end(), [](auto &c) { return c->finished(); }),
+                  retired.end());
+}
+
+void cm::application::await_dependencies(const config_map::configured_application &app, supervision &s) {
+
+    log->err(app_name, "Application " + app.name + " waits for its dependencies");
+
+    s.started = false;
+    if (s.ready) {
+        s.ready = false;
+        ready_apps--;
+    }
+    create_probe(app, s);
+
+    // dependents which aren't started yet wait for it again
+    for (const auto *dependent : s.dependents) {
+        auto &d = supervised.at(dependent->name);
+        if (!d.started)
+            d.waiting++;
+    }
+}
+
+const cm::config_map::configured_application *cm::application::current(const std::string &name) const {
+    auto it = std::find_if(map->apps.begin(), map->apps.end(), [&name](auto &app) { return app.name == name; });
+    return it == map->apps.end() ? nullptr : &*it;
+}
+
+std::shared_ptr<const cm::config_map::configured_application>
+cm::application::hold(const config_map::configured_application &app) const {
+    auto owns = [&app](const config_map &m) {
+        std::less<const config_map::configured_application *> before;
+        return !m.apps.empty() && !before(&app, &m.apps.front()) && !before(&m.apps.back(), &app);
+    };
+
+    if (owns(*map))
+        return {map, &app};
+    for (const auto &generation : generations)
+        if (auto g = generation.lock(); g && owns(*g))
+            return {g, &app};
+
+    // not part of any configuration, nothing to keep alive
+    return {std::shared_ptr<const config_map>(), &app};
+}
+
+void cm::application::reload_handler() {
+
+    if (shutdown_running.load())
+        return;
+
+    std::shared_ptr<config_map> next;
+    try {
+        next = map->reload();
+    } catch (const config_map_exception &e) {
+        log->err(app_name, std::string("Reload failed, keeping the running configuration: ") + e.what());
+        return;
+    }
+
+    try {
+        open_listeners(*next);
+    } catch (const std::system_error &e) {
+        log->err(app_name, std::string("Reload failed, keeping the running configuration: ") + e.what());
+        return;
+    }
+
+    auto find = [](const config_map &m, const std::string &name) {
+        return std::find_if(m.apps.begin(), m.apps.end(), [&name](auto &app) { return app.name == name; });
+    };
+
+    report_suppressed();
+
+    std::size_t removed = 0, unchanged = 0;
+    std::vector<const config_map::configured_application *> added, changed;
+
+    for (const auto &app : map->apps) {
+        if (find(*next, app.name) != next->apps.end())
+            continue;
+
+        log->err(app_name, "Removing application " + app.name);
+        removed++;
+
+        auto &s = supervised.at(app.name);
+        s.removed = true;
+        retire_probe(s);
+        schedules.cancel(s.next_run);
+        s.next_run = nullptr;
+        s.scheduled = false;
+        s.queued_runs = 0;
+        if (s.ready) {
+            s.ready = false;
+            ready_apps--;
+        }
+
+        // the child of a running app is retired by the exit handler once it exited
+        if (!s.started) {
+            s.started = true;
+        } else if (s.restart_pending) {
+            s.restart_pending = false;
+            s.restart_timer.cancel();
+            retire_child(app.name);
+        } else if (s.metrics.running.load()) {
+            stop_app(app, false);
+        } else {
+            // apps which are down were counted as completed
+            completed_apps--;
+            retire_child(app.name);
+        }
+    }
+
+    for (const auto &app : next->apps) {
+        auto old = find(*map, app.name);
+        if (old == map->apps.end())
+            added.push_back(&app);
+        else if (*old != app)
+            changed.push_back(&app);
+        else
+            unchanged++;
+    }
+
+    generations.erase(std::remove_if(generations.begin(), generations.end(), [](auto &g) { return g.expired(); }),
+                      generations.end());
+    generations.push_back(map);
+    map = next;
+
+    for (const auto *app : added) {
+        log->err(app_name, "Adding application " + app->name);
+
+        std::lock_guard<std::mutex> lock(children_mutex);
+        auto it = supervised.find(app->name);
+        if (it == supervised.end()) {
+            create_probe(*app, supervised.try_emplace(app->name, *app, ios).first->second);
+            continue;
+        }
+
+        // removed by an earlier reload
+        auto &s = it->second;
+        s.removed = false;
+        s.stopped = false;
+        s.ready = false;
+        s.policy = restart_policy(*app);
+        log_limits.erase(app->name);
+
+        if (s.stop_requested) {
+            // still stopping, it starts again right after its exit without another readiness check
+            s.started = true;
+            s.restart_requested = true;
+        } else {
+            s.started = false;
+            create_probe(*app, s);
+        }
+    }
+
+    for (auto &it : supervised)
+        it.second.dependents.clear();
+
+    for (const auto &app : map->apps) {
+        auto &s = supervised.at(app.name);
+        s.waiting = 0;
+        for (const auto &dependency : app.depends_on) {
+            auto &d = supervised.at(dependency);
+            d.dependents.push_back(&app);
+            if (!d.ready)
+                s.waiting++;
+        }
+    }
+
+    for (const auto *app : changed) {
+        auto &s = supervised.at(app->name);
+        s.policy = restart_policy(*app);
+        {
+            std::lock_guard<std::mutex> lock(children_mutex);
+            log_limits.erase(app->name);
+        }
+
+        if (!s.started) {
+            create_probe(*app, s);
+        } else if (s.scheduled || app->schedule) {
+            // a run in progress finishes with the old definition, the new schedule applies from now on
+            bool was_scheduled = s.scheduled;
+            schedules.cancel(s.next_run);
+            s.next_run = nullptr;
+            s.queued_runs = 0;
+            s.scheduled = static_cast<bool>(app->schedule);
+            if (s.scheduled)
+                arm_schedule(*app);
+
+            // turned from a job into a long running app or the other way round, it starts over as such
+            bool running = s.metrics.running.load() && !s.stop_requested;
+            if (was_scheduled != s.scheduled && running) {
+                log->err(app_name, "Restarting changed application " + app->name);
+                stop_app(*app, true);
+            } else if (was_scheduled && !s.scheduled && !running && !s.stop_requested && !s.stopped) {
+                auto error = start_app(*app);
+                if (!error.empty())
+                    log->err(app_name, error);
+            }
+        } else if (s.metrics.running.load() && !s.stop_requested) {
+            // the exit handler starts it with the definition of the new configuration, or leaves it to
+            // ready_handler if it depends on apps which aren't ready yet
+            log->err(app_name, "Restarting changed application " + app->name);
+            stop_app(*app, true);
+        }
+        // pending restarts and apps which are down get the new definition on their next start
+    }
+
+    for (const auto &app : map->apps) {
+        auto &s = supervised.at(app.name);
+        if (s.started || s.waiting > 0)
+            continue;
 
         try {
+            launch(app);
+        } catch (const std::runtime_error &) {
+            s.started = true;
+            completed_apps++;
+        }
+    }
+
+    bool limited = std::any_of(map->apps.begin(), map->apps.end(), [](auto &app) { return app.log_rate > 0; });
+    if (limited && !reporting_suppressed)
+        start_suppressed_timer();
+
+    log->err(app_name, "Reloaded configuration: " + std::to_string(added.size()) + " added, " +
+                       std::to_string(removed) + " removed, " + std::to_string(changed.size()) + " changed, " +
+                       std::to_string(unchanged) + " unchanged");
+}
+
+void cm::application::open_listeners(const config_map &config) {
 
-            boost::filesystem::path path;
+    // everything new is bound before anything changes, a failure throws and closes only those
+    std::map<std::string, std::unique_ptr<listen_socket>> bound;
+    std::vector<std::string> announced;
 
-            if (boost::filesystem::exists(app.executable))
-                path = app.executable;
+    for (const auto &app : config.apps) {
+        for (const auto &address : app.listen) {
+            auto key = listener_key(app, address);
+            if (listeners.count(key) || bound.count(key))
+                continue;
+
+            bound[key] = std::make_unique<listen_socket>(address);
+            announced.push_back("Listening on " + address + " for " + app.name);
+        }
+    }
+
+    std::map<std::string, std::unique_ptr<listen_socket>> open;
+    for (const auto &app : config.apps) {
+        for (const auto &address : app.listen) {
+            auto key = listener_key(app, address);
+            if (open.count(key))
+                continue;
+            auto it = listeners.find(key);
+            open[key] = std::move(it != listeners.end() ? it->second : bound.at(key));
+        }
+    }
+
+    // apps still running with a closed socket keep their own copy of it until they exit
+    listeners = std::move(open);
+
+    for (const auto &message : announced)
+        log->err(app_name, message);
+}
+
+std::vector<int> cm::application::listen_fds(const config_map::configured_application &app) const {
+    std::vector<int> fds;
+    for (const auto &address : app.listen) {
+        auto it = listeners.find(listener_key(app, address));
+        if (it != listeners.end())
+            fds.push_back(it->second->fd());
+    }
+    return fds;
+}
+
+void cm::application::start_child(const config_map::configured_application &app) {
+
+    try {
+
+        line_buffer::limits limits;
+        limits.max_line_length = app.max_line_length;
+        limits.max_buffered = app.max_buffered_bytes;
+        limits.truncate = app.truncate_long_lines;
+
+        auto &s = supervised.at(app.name);
+
+        {
+            std::lock_guard<std::mutex> lock(children_mutex);
+            auto it = children.find(app.name);
+            if (it != children.end() && !it->second->terminated()) {
+                log->err(app_name, "Not starting application " + app.name + ", its previous process still runs");
+                throw std::runtime_error(app.name + " still runs");
+            }
+        }
+
+        s.metrics.out.timed = s.metrics.err.timed = measuring_latency;
+        trace::span span("start child", app.name);
+        auto begin = std::chrono::steady_clock::now();
+
+        std::unique_ptr<child> a = std::make_unique<child>(
+                app.name, *app.spawn, listen_fds(app), app.term_signal,
+                app.mode, limits, ios, proc_group, *reaper, pool, ring.get(), s.metrics
+        );
+
+        auto spawned = std::chrono::steady_clock::now();
+
+        s.metrics.starts.fetch_add(1, std::memory_order_relaxed);
+        s.metrics.started_ns.store(spawned.time_since_epoch().count(), std::memory_order_relaxed);
+        s.metrics.running.store(true, std::memory_order_relaxed);
+
+        if (sampler)
+            sampler->add(app.name, a->pid());
+
+        auto probe = app.ready == config_map::ready_probe::LOG ? s.probe : nullptr;
+
+        std::shared_ptr<token_bucket> limit;
+        if (app.log_rate > 0) {
+            std::lock_guard<std::mutex> lock(children_mutex);
+            auto &bucket = log_limits[app.name];
+            if (!bucket)
+                bucket = std::make_shared<token_bucket>(app.log_rate, app.log_burst);
+            limit = bucket;
+        }
+
+        // shared by both streams of this start, only allocated when tracing
+        std::shared_ptr<std::atomic_bool> first_output;
+        if (trace::enabled())
+            first_output = std::make_shared<std::atomic_bool>(false);
+
+        a->set_on_stdout([this, &app, &s, limit, probe, first_output, &m = s.metrics.out](std::string_view line) {
+            if (first_output && !first_output->exchange(true))
+                trace::instant("first output", app.name);
+            if (probe)
+                probe->offer(line);
+            if (limit && !limit->try_take()) {
+                m.dropped.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            m.lines.fetch_add(1, std::memory_order_relaxed);
+            line_origin from{&s.metrics.latency, m.read_ns.load(std::memory_order_relaxed)};
+            log->out(app.name, line, m.timed ? &from : nullptr);
+            if (s.tailed.load(std::memory_order_relaxed))
+                tail(s, line);
+            return !log->congested();
+        });
+
+        a->set_on_stderr([this, &app, &s, limit, probe, first_output, &m = s.metrics.err](std::string_view line) {
+            if (first_output && !first_output->exchange(true))
+                trace::instant("first output", app.name);
+            if (probe)
+                probe->offer(line);
+            if (limit && !limit->try_take()) {
+                m.dropped.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            m.lines.fetch_add(1, std::memory_order_relaxed);
+            line_origin from{&s.metrics.latency, m.read_ns.load(std::memory_order_relaxed)};
+            log->err(app.name, line, m.timed ? &from : nullptr);
+            if (s.tailed.load(std::memory_order_relaxed))
+                tail(s, line);
+            return !log->congested();
+        });
+
+        // keeps the app's configuration alive as long as the child, the output handlers rely on it too
+        a->set_on_exit([this, app = hold(app)](const int exit_code, const std::error_code &code) {
+            boost::asio::post(control, [this, app, exit_code]() { exit_handler(*app, exit_code); });
+        });
+
+        log->err(app_name, "Started application " + app.name + " (pid " + std::to_string(a->pid()) + ") in " +
+                           format_ms(spawned - begin) + ", " + format_ms(spawned - process_start) +
+                           " after start of " + app_name);
+
+        std::lock_guard<std::mutex> lock(children_mutex);
+
+        s.policy.started(spawned);
+
+        // restarts don't go through the readiness check again
+        if (!s.started) {
+            s.started = true;
+            if (s.probe)
+                s.probe->start();
             else
-                path = bp::search_path(app.executable);
+                boost::asio::post(control, [this, app = hold(app)]() { ready_handler(*app); });
+        }
 
-            std::unique_ptr<child> a = std::make_unique<child>(
-                    app.name, path, app.args,
-                    boost::filesystem::canonical(app.context), app.env, app.term_signal,
-                    ios, proc_group
-            );
+        auto &slot = children[app.name];
+        if (slot)
+            retired.push_back(std::move(slot));
+        slot = std::move(a);
 
-            a->set_on_stdout([this, &app](const child::stream_content_type &buf) {
-                linebuffer.available(app.name + "_out", buf, [this, app](const std::string &line) {
-                    log->out(app.name, line);
-                });
-            });
+        retired.erase(std::remove_if(retired.begin(), retired.end(), [](auto &c) { return c->finished(); }),
+                      retired.end());
 
-            a->set_on_stderr([this, &app](const child::stream_content_type &buf) {
-                linebuffer.available(app.name + "_err", buf, [this, app](const std::string &line) {
-                    log->err(app.name, line);
-                });
-            });
+    } catch (bp::process_error &e) {
+        log->err(app_name,
+                 "Failed to start process: " + app.name + ": " + e.what() + ". executable is: " + app.executable);
+        throw std::runtime_error(e.what());
+    }
+}
+
+void cm::application::launch(const config_map::configured_application &app) {
+    if (app.schedule)
+        schedule_app(app);
+    else
+        start_child(app);
+}
+
+void cm::application::schedule_app(const config_map::configured_application &app) {
+
+    auto &s = supervised.at(app.name);
+
+    // between its runs a scheduled app counts as completed, every run is started like by cm ctl start
+    s.started = true;
+    s.scheduled = true;
+    completed_apps++;
+    arm_schedule(app);
+
+    if (s.next_run) {
+        char due[32];
+        std::time_t t = std::chrono::system_clock::to_time_t(s.next_due);
+        std::tm tm{};
+        ::localtime_r(&t, &tm);
+        std::strftime(due, sizeof(due), "%Y-%m-%d %H:%M", &tm);
+        log->err(app_name, "Scheduled application " + app.name + " (" + app.schedule->expression() +
+                           "), first run at " + due);
+    }
+
+    boost::asio::post(control, [this, app = hold(app)]() { ready_handler(*app); });
+}
+
+void cm::application::arm_schedule(const config_map::configured_application &app) {
 
-            a->set_on_exit([this, &app](const int exit_code, const std::error_code &code) {
-                log->err(app_name, "Application " + app.name + " exited with code " + std::to_string(exit_code) + ".");
-                completed_apps++;
-                if (app.fail_on_exit) {
-                    shutdown_handler();
-                } else {
-                    if (exit_code != 0) {
-                        if (app.fail_on_nonzero_exit)
-                            shutdown_handler();
-                    }
-                }
+    auto &s = supervised.at(app.name);
+    auto now = std::chrono::system_clock::now();
 
+    // never the same minute twice, even when the wall clock went back a little
+    s.next_due = app.schedule->next(std::max(now, s.next_due));
+    if (s.next_due == std::chrono::system_clock::time_point::max()) {
+        log->err(app_name, "Schedule " + app.schedule->expression() + " of app " + app.name + " never matches");
+        return;
+    }
+
+    auto delay = std::chrono::duration_cast<timing_wheel::clock::duration>(s.next_due - now);
+    if (app.schedule_jitter.total_milliseconds() > 0) {
+        std::uniform_int_distribution<long long> jitter(0, app.schedule_jitter.total_milliseconds());
+        delay += std::chrono::milliseconds(jitter(random));
+    }
+
+    s.next_run = schedules.schedule(delay, [this, name = app.name]() { schedule_handler(name); });
+}
+
+void cm::application::schedule_handler(const std::string &name) {
+
+    auto &s = supervised.at(name);
+    const auto *app = current(name);
+    s.next_run = nullptr;
+
+    if (!app || !s.scheduled || shutdown_running.load())
+        return;
+
+    arm_schedule(*app);
+
+    // stopped by cm ctl, the schedule is paused until the app is started again
+    if (s.stopped)
+        return;
+
+    if (!s.metrics.running.load() && !s.stop_requested) {
+        log->err(app_name, "Running scheduled application " + name);
+        auto error = start_app(*app);
+        if (!error.empty())
+            log->err(app_name, error);
+        return;
+    }
+
+    switch (app->overlap) {
+        case config_map::overlap_policy::SKIP:
+            log->err(app_name, "Skipping run of application " + name + ", the previous one is still running");
+            break;
+        case config_map::overlap_policy::QUEUE:
+            s.queued_runs++;
+            log->err(app_name, "Queueing run of application " + name + ", " + std::to_string(s.queued_runs) +
+                               " waiting for the previous one");
+            break;
+        case config_map::overlap_policy::KILL:
+            // the exit handler starts the new run once the previous one is gone
+            log->err(app_name, "Replacing the still running previous run of application " + name);
+            stop_app(*app, true);
+            break;
+    }
+}
+
+void cm::application::exit_handler(const config_map::configured_application &app, int exit_code) {
+
+    log->err(app_name, "Application " + app.name + " exited with code " + std::to_string(exit_code) + ".");
+
+    auto &s = supervised.at(app.name);
+    s.metrics.exits.fetch_add(1, std::memory_order_relaxed);
+
+    if (s.terminating) {
+        s.terminating = false;
+        s.stop_timer.cancel();
+    }
+
+    trace::instant("exit", app.name);
+    if (s.terminated != trace::clock::time_point()) {
+        trace::complete("stop", app.name, s.terminated, trace::clock::now());
+        s.terminated = {};
+    }
+    s.metrics.last_exit_code.store(exit_code, std::memory_order_relaxed);
+    s.metrics.running.store(false, std::memory_order_relaxed);
+
+    // stopped or restarted by cm ctl, neither restart-policy nor fail-on-exit apply
+    if (s.stop_requested) {
+        s.stop_requested = false;
+        s.stop_timer.cancel();
+        if (!s.removed)
+            completed_apps++;
+
+        if (s.restart_requested && !shutdown_running.load()) {
+            s.restart_requested = false;
+            if (s.waiting > 0) {
+                // apps waiting for their dependencies don't count as completed
+                completed_apps--;
+                await_dependencies(*current(app.name), s);
+                return;
+            }
+            log->err(app_name, "Restarting application " + app.name);
+            // a reload may have changed the app in the meantime
+            auto error = start_app(*current(app.name));
+            if (!error.empty())
+                log->err(app_name, error);
+            return;
+        }
+
+        s.restart_requested = false;
+        s.stopped = true;
+        s.queued_runs = 0;
+        log->err(app_name, "Application " + app.name + (s.removed ? " removed" : " stopped"));
+        if (s.removed)
+            retire_child(app.name);
+
+        if (shutdown_running.load())
+            shutdown_handler();
+        return;
+    }
+
+    // a run of a scheduled app is done, neither restart-policy nor fail-on-exit apply
+    if (app.schedule) {
+        completed_apps++;
+
+        if (shutdown_running.load()) {
+            shutdown_handler();
+        } else if (s.queued_runs > 0 && s.scheduled) {
+            s.queued_runs--;
+            log->err(app_name, "Running queued run of application " + app.name);
+            auto error = start_app(*current(app.name));
+            if (!error.empty())
+                log->err(app_name, error);
+        }
+        return;
+    }
+
+    if (!shutdown_running.load()) {
+        auto decision = s.policy.exited(exit_code, std::chrono::steady_clock::now());
+
+        if (decision.what == restart_policy::action::RESTART) {
+            log->err(app_name, "Restarting application " + app.name + " in " +
+                               std::to_string(decision.delay.count()) + " ms");
+            s.restart_pending = true;
+            s.restart_timer.expires_after(decision.delay);
+            s.restart_timer.async_wait(boost::asio::bind_executor(control, [this, app = hold(app)](auto &ec) {
+                restart_timeout_handler(*app, ec);
+            }));
+            return;
+        }
+
+        if (decision.what == restart_policy::action::CRASH_LOOP) {
+            log->err(app_name, "Application " + app.name + " is crash looping, " +
+                               std::to_string(s.policy.recent_restarts()) + " restarts within restart-window");
+            completed_apps++;
+            shutdown_handler();
+            return;
+        }
+    }
+
+    completed_apps++;
+
+    if (s.probe && !s.ready && !shutdown_running.load()) {
+        log->err(app_name, "Application " + app.name + " exited before it was ready");
+        s.probe->cancel();
+        shutdown_handler();
+        return;
+    }
+
+    if (shutdown_running.load() || app.fail_on_exit) {
+        shutdown_handler();
+    } else {
+        if (exit_code != 0) {
+            if (app.fail_on_nonzero_exit)
+                shutdown_handler();
+        }
+    }
+}
+
+void cm::application::restart_timeout_handler(const config_map::configured_application &app,
+                                               const boost::system::error_code &ec) {
+
+    auto &s = supervised.at(app.name);
+
+    // cancel_pending already accounted for the app
+    if (ec == boost::asio::error::operation_aborted || !s.restart_pending)
+        return;
+
+    s.restart_pending = false;
+
+    if (s.waiting > 0) {
+        await_dependencies(*current(app.name), s);
+        return;
+    }
+
+    try {
+        start_child(*current(app.name));
+    } catch (const std::runtime_error &) {
+        completed_apps++;
+        shutdown_handler();
+    }
+}
+
+void cm::application::ready_handler(const config_map::configured_application &app) {
+
+    auto &s = supervised.at(app.name);
+    s.ready = true;
+    ready_apps++;
+
+    auto now = std::chrono::steady_clock::now();
+    log->err(app_name, "Application " + app.name + " is ready, " + format_ms(now - process_start) +
+                       " after start of " + app_name);
+
+    if (ready_apps == map->apps.size())
+        log->err(app_name, "All applications ready, " + format_ms(now - process_start) +
+                           " after start of " + app_name);
+
+    if (shutdown_running.load())
+        return;
+
+    for (const auto *dependent : s.dependents) {
+        auto &d = supervised.at(dependent->name);
+
+        // already running, the dependency became ready again after a reload or await_dependencies
+        if (d.started || --d.waiting > 0)
+            continue;
+
+        try {
+            launch(*dependent);
+        } catch (const std::runtime_error &) {
+            d.started = true;
+            completed_apps++;
+            shutdown_handler();
+            return;
+        }
+    }
+}
+
+void cm::application::ready_timeout_handler(const config_map::configured_application &app) {
+    log->err(app_name, "Application " + app.name + " did not become ready within " +
+                       std::to_string(app.ready_timeout.total_milliseconds()) + " ms");
+    shutdown_handler();
+}
+
+void cm::application::cancel_pending() {
+    schedules.stop();
+
+    for (auto &it : supervised) {
+        auto &s = it.second;
+
+        if (s.removed)
+            continue;
+
+        if (s.probe)
+            s.probe->cancel();
+
+        if (!s.started) {
+            log->err(app_name, "Not starting app " + it.first);
+            s.started = true;
+            completed_apps++;
+        }
+
+        if (s.restart_pending) {
+            log->err(app_name, "Cancelling restart of app " + it.first);
+            s.restart_pending = false;
+            s.restart_timer.cancel();
+            completed_apps++;
+        }
+    }
+}
+
+void cm::application::render_metrics(std::string &out) {
+
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+
+    // a reload adds apps while metrics are rendered
+    std::lock_guard<std::mutex> lock(children_mutex);
+
+    auto per_stream = [this, &out](std::string_view name, std::string_view type, std::string_view help,
+                                   auto value) {
+        append_metric_header(out, name, type, help);
+        for (const auto &it : supervised) {
+            if (it.second.removed)
+                continue;
+            append_metric(out, name, {{"app", it.first}, {"stream", "stdout"}}, value(it.second.metrics.out));
+            append_metric(out, name, {{"app", it.first}, {"stream", "stderr"}}, value(it.second.metrics.err));
+        }
+    };
+
+    auto per_app = [this, &out](std::string_view name, std::string_view type, std::string_view help, auto value) {
+        append_metric_header(out, name, type, help);
+        for (const auto &it : supervised)
+            if (!it.second.removed)
+                append_metric(out, name, {{"app", it.first}}, value(it.second.metrics));
+    };
+
+    auto load = [](const std::atomic<std::uint64_t> &v) {
+        return static_cast<double>(v.load(std::memory_order_relaxed));
+    };
+
+    per_stream("cm_app_read_bytes_total", "counter", "Bytes read from the output of the app.",
+               [&](const stream_metrics &m) { return load(m.bytes); });
+    per_stream("cm_app_read_calls_total", "counter", "Reads returning output of the app.",
+               [&](const stream_metrics &m) { return load(m.reads); });
+    per_stream("cm_app_read_chunk_bytes", "gauge", "Average number of bytes returned by a read.",
+               [&](const stream_metrics &m) { return m.reads ? load(m.bytes) / load(m.reads) : 0.0; });
+    per_stream("cm_app_lines_total", "counter", "Lines of the app passed to the log.",
+               [&](const stream_metrics &m) { return load(m.lines); });
+    per_stream("cm_app_lines_dropped_total", "counter", "Lines of the app dropped by its log-rate.",
+               [&](const stream_metrics &m) { return load(m.dropped); });
+
+    per_app("cm_app_restarts_total", "counter", "Restarts of the app.", [&](const app_metrics &m) {
+        return std::max(0.0, load(m.starts) - 1);
+    });
+    per_app("cm_app_exits_total", "counter", "Exits of the app.", [&](const app_metrics &m) {
+        return load(m.exits);
+    });
+    per_app("cm_app_last_exit_code", "gauge", "Exit code of the last exit of the app.", [&](const app_metrics &m) {
+        return static_cast<double>(m.last_exit_code.load(std::memory_order_relaxed));
+    });
+    per_app("cm_app_up", "gauge", "1 while the app is running.", [&](const app_metrics &m) {
+        return m.running.load(std::memory_order_relaxed) ? 1.0 : 0.0;
+    });
+    per_app("cm_app_uptime_seconds", "gauge", "Seconds since the last start of the running app.",
+            [&](const app_metrics &m) {
+                if (!m.running.load(std::memory_order_relaxed))
+                    return 0.0;
+                std::chrono::steady_clock::duration up(now - m.started_ns.load(std::memory_order_relaxed));
+                return std::chrono::duration<double>(up).count();
             });
 
-            children[app.name] = std::move(a);
+    if (measuring_latency) {
+        append_metric_header(out, "cm_app_log_latency_seconds", "summary",
+                             "Time from reading a line of the app until its record was written.");
+        for (const auto &it : supervised) {
+            if (it.second.removed)
+                continue;
+            auto values = it.second.metrics.latency.take();
+            for (const auto *q : {"0.5", "0.99", "0.999"})
+                append_metric(out, "cm_app_log_latency_seconds", {{"app", it.first}, {"quantile", q}},
+                              static_cast<double>(values.percentile(std::stod(q))) / 1e9);
+            append_metric(out, "cm_app_log_latency_seconds_count", {{"app", it.first}},
+                          static_cast<double>(values.total));
+        }
+    }
+
+    if (reaper->reaping_orphans()) {
+        append_metric_header(out, "cm_orphans_reaped_total", "counter",
+                             "Processes left behind by the apps which cm reaped.");
+        append_metric(out, "cm_orphans_reaped_total", {}, static_cast<double>(reaper->orphans_reaped()));
+    }
+
+    auto stats = log->stats();
+
+    append_metric_header(out, "cm_log_queue_depth", "gauge", "Log records waiting for the log writer.");
+    append_metric(out, "cm_log_queue_depth", {}, static_cast<double>(stats.queued));
+    append_metric_header(out, "cm_log_records_dropped_total", "counter", "Log records dropped on a full queue.");
+    append_metric(out, "cm_log_records_dropped_total", {}, static_cast<double>(stats.dropped));
+    append_metric_header(out, "cm_log_write_latency_seconds", "summary",
+                         "Time from formatting a log record until it was written.");
+    append_metric(out, "cm_log_write_latency_seconds_sum", {}, std::chrono::duration<double>(stats.latency).count());
+    append_metric(out, "cm_log_write_latency_seconds_count", {}, static_cast<double>(stats.written));
+}
+
+void cm::application::control_handler(const std::vector<std::string> &request,
+                                       const std::shared_ptr<control_session> &session) {
+
+    std::string joined;
+    for (const auto &word : request)
+        joined += (joined.empty() ? "" : " ") + word;
+    log->err(app_name, "Control command: " + joined);
+
+    auto reply = [&session](const std::string &error, const std::string &output) {
+        session->send(error.empty() ? "ok\n" + output : "error: " + error + "\n");
+        session->close();
+    };
+
+    const std::string command = request.empty() ? "" : request[0];
+
+    if (command == "status" && request.size() == 1) {
+        reply("", control_status());
+        return;
+    }
+
+    static const std::vector<std::string> with_app = {"start", "stop", "restart", "signal", "tail"};
+    if (std::find(with_app.begin(), with_app.end(), command) == with_app.end() ||
+        request.size() != (command == "signal" ? 3 : 2)) {
+        reply("usage: status | start APP | stop APP | restart APP | signal APP SIGNAL | tail APP", "");
+        return;
+    }
+
+    auto app = std::find_if(map->apps.begin(), map->apps.end(), [&](auto &a) { return a.name == request[1]; });
+    if (app == map->apps.end()) {
+        reply("unknown app " + request[1], "");
+        return;
+    }
+
+    auto &s = supervised.at(app->name);
+
+    if (command == "start") {
+        reply(start_app(*app), "");
+    } else if (command == "stop" || command == "restart") {
+        reply(stop_app(*app, command == "restart"), "");
+    } else if (command == "signal") {
+        auto name = boost::to_upper_copy(request[2]);
+        bool numeric = name.size() <= 2 && std::all_of(name.begin(), name.end(), ::isdigit);
+        int signal_number;
+        try {
+            signal_number = numeric ? std::stoi(name) : control_signal_to_int(name.rfind("SIG", 0) == 0 ? name
+                                                                                                          : "SIG" + name);
+        } catch (const config_map_exception &e) {
+            reply(e.what(), "");
+            return;
+        }
+
+        // 0 only checks whether the process exists, ctl wants a signal delivered
+        if (signal_number < 1 || signal_number >= NSIG) {
+            reply("Invalid signal " + request[2], "");
+            return;
+        }
+
+        if (!s.metrics.running.load()) {
+            reply(app->name + " is not running", "");
+            return;
+        }
+
+        int error;
+        {
+            std::lock_guard<std::mutex> lock(children_mutex);
+            error = children.at(app->name)->send_signal(signal_number);
+        }
+        reply(error ? "Can't signal " + app->name + ": " + std::strerror(error) : "", "");
+    } else {
+        if (app->mode == config_map::log_mode::RAW) {
+            reply(app->name + " writes its output raw, there are no lines to tail", "");
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(s.tail_mutex);
+        session->send("ok\n");
+        s.tails.push_back(session);
+        s.tailed = true;
+    }
+}
+
+std::string cm::application::control_status() {
+
+    std::vector<resource_sampler::usage> usage;
+    if (sampler)
+        usage = sampler->snapshot();
+
+    auto now = std::chrono::steady_clock::now();
+    std::string rows;
+    std::size_t running = 0;
+    char buf[256];
+
+    std::snprintf(buf, sizeof(buf), "%-24s %-10s %8s %10s %8s %5s %7s %9s\n",
+                  "APP", "STATE", "PID", "UPTIME", "RESTARTS", "EXIT", "CPU%", "RSS");
+    rows += buf;
+
+    for (const auto &app : map->apps) {
+        const auto &s = supervised.at(app.name);
+        bool up = s.metrics.running.load();
+
+        std::string state;
+        if (!s.started)
+            state = "waiting";
+        else if (s.stop_requested)
+            state = "stopping";
+        else if (up)
+            state = s.probe && !s.ready ? "starting" : "running";
+        else if (s.restart_pending)
+            state = "restarting";
+        else if (s.stopped)
+            state = "stopped";
+        else if (s.scheduled)
+            state = "scheduled";
+        else
+            state = "exited";
+
+        std::string pid = "-", uptime = "-", cpu = "-", rss = "-";
+        if (up) {
+            running++;
+            int p;
+            {
+                std::lock_guard<std::mutex> lock(children_mutex);
+                p = children.at(app.name)->pid();
+            }
+            pid = std::to_string(p);
+
+            std::chrono::steady_clock::duration d(now.time_since_epoch().count() - s.metrics.started_ns.load());
+            std::snprintf(buf, sizeof(buf), "%.1fs", std::chrono::duration<double>(d).count());
+            uptime = buf;
+
+            auto u = std::find_if(usage.begin(), usage.end(), [p](auto &u) { return u.pid == p; });
+            if (u != usage.end()) {
+                std::snprintf(buf, sizeof(buf), "%.1f", u->cpu_percent);
+                cpu = buf;
+                std::snprintf(buf, sizeof(buf), "%.1fM", static_cast<double>(u->rss_bytes) / (1 << 20));
+                rss = buf;
+            }
+        }
+
+        auto starts = s.metrics.starts.load();
+        std::string last_exit = s.metrics.exits.load() > 0 ? std::to_string(s.metrics.last_exit_code.load()) : "-";
+
+        std::snprintf(buf, sizeof(buf), "%-24s %-10s %8s %10s %8llu %5s %7s %9s\n",
+                      app.name.c_str(), state.c_str(), pid.c_str(), uptime.c_str(),
+                      static_cast<unsigned long long>(starts > 0 ? starts - 1 : 0), last_exit.c_str(), cpu.c_str(),
+                      rss.c_str());
+        rows += buf;
+    }
+
+    std::snprintf(buf, sizeof(buf), "%s %s pid %d up %.1fs, %zu of %zu apps running%s\n",
+                  app_name.c_str(), app_version.c_str(), static_cast<int>(::getpid()),
+                  std::chrono::duration<double>(now - process_start).count(), running, map->apps.size(),
+                  shutdown_running.load() ? ", shutting down" : "");
+
+    return buf + rows;
+}
+
+std::string cm::application::start_app(const config_map::configured_application &app) {
 
-        } catch (bp::process_error &e) {
-            log->err(app_name,
-                     "Failed to start process: " + app.name + ": " + e.what() + ". executable is: " + app.executable);
-            throw std::runtime_error(e.what());
+    auto &s = supervised.at(app.name);
+
+    if (shutdown_running.load())
+        return "shutting down";
+    if (!s.started)
+        return app.name + " is waiting for its dependencies";
+    if (s.metrics.running.load() || s.stop_requested)
+        return app.name + " is already running";
+
+    // a pending restart is moved forward, apps which are down were counted as completed
+    if (s.restart_pending) {
+        s.restart_pending = false;
+        s.restart_timer.cancel();
+    } else {
+        completed_apps--;
+    }
+
+    s.stopped = false;
+
+    try {
+        start_child(app);
+    } catch (const std::runtime_error &e) {
+        completed_apps++;
+        return "failed to start " + app.name + ": " + e.what();
+    }
+    return "";
+}
+
+std::string cm::application::stop_app(const config_map::configured_application &app, bool restart) {
+
+    auto &s = supervised.at(app.name);
+
+    if (shutdown_running.load())
+        return "shutting down";
+    if (!s.started)
+        return app.name + " is waiting for its dependencies";
+
+    if (!s.metrics.running.load()) {
+        if (restart)
+            return start_app(app);
+        if (s.scheduled && !s.stopped) {
+            s.stopped = true;
+            s.queued_runs = 0;
+            log->err(app_name, "Pausing schedule of app " + app.name);
+            return "";
         }
+        if (!s.restart_pending)
+            return app.name + " is not running";
+
+        s.restart_pending = false;
+        s.restart_timer.cancel();
+        s.stopped = true;
+        completed_apps++;
+        log->err(app_name, "Cancelling restart of app " + app.name);
+        return "";
     }
+
+    s.restart_requested = restart;
+    if (s.stop_requested)
+        return "";
+
+    s.stop_requested = true;
+    s.terminated = trace::clock::now();
+    log->err(app_name, "Terminating app " + app.name);
+    {
+        std::lock_guard<std::mutex> lock(children_mutex);
+        children.at(app.name)->terminate();
+    }
+
+    s.stop_timer.expires_from_now(app.stop_timeout.total_milliseconds() > 0 ? app.stop_timeout : map->kill_delay);
+    s.stop_timer.async_wait(boost::asio::bind_executor(control, [this, app = hold(app)](auto &ec) {
+        stop_timeout_handler(*app, ec);
+    }));
+    return "";
+}
+
+void cm::application::stop_timeout_handler(const config_map::configured_application &app,
+                                            const boost::system::error_code &ec) {
+
+    auto &s = supervised.at(app.name);
+    if (ec == boost::asio::error::operation_aborted || !(s.stop_requested || s.terminating))
+        return;
+
+    log->err(app_name, "Forcibly terminating app " + app.name);
+    std::lock_guard<std::mutex> lock(children_mutex);
+    children.at(app.name)->kill();
+}
+
+void cm::application::tail(supervision &s, std::string_view line) {
+    std::string text;
+    text.reserve(line.size() + 1);
+    text.append(line).push_back('\n');
+
+    std::lock_guard<std::mutex> lock(s.tail_mutex);
+    s.tails.erase(std::remove_if(s.tails.begin(), s.tails.end(), [&text](auto &t) { return !t->send(text); }),
+                  s.tails.end());
+    if (s.tails.empty())
+        s.tailed = false;
+}
+
+void cm::application::report_suppressed() {
+    for (auto &it : log_limits) {
+        std::size_t suppressed = it.second->take_suppressed();
+        if (suppressed > 0)
+            log->err(app_name, std::to_string(suppressed) + " lines of application " + it.first +
+                               " suppressed by log-rate limit");
+    }
+}
+
+void cm::application::suppressed_timeout_handler(const boost::system::error_code &ec) {
+    if (ec == boost::asio::error::operation_aborted)
+        return;
+
+    report_suppressed();
+    start_suppressed_timer();
+}
+
+void cm::application::start_suppressed_timer() {
+    reporting_suppressed = true;
+    suppressed_timer.expires_from_now(boost::posix_time::seconds(1));
+    suppressed_timer.async_wait(boost::asio::bind_executor(control, [this](auto &ec) {
+        suppressed_timeout_handler(ec);
+    }));
+}
+
+void cm::application::report_latency(bool since_start) {
+    for (auto &it : supervised) {
+        auto &s = it.second;
+        if (s.removed)
+            continue;
+
+        auto now = s.metrics.latency.take();
+        auto values = since_start ? now : now - s.latency_reported;
+        s.latency_reported = now;
+        if (values.total == 0)
+            continue;
+
+        auto us = [&values](double p) { return static_cast<double>(values.percentile(p)) / 1000; };
+        log->log(logger::stream::STDERR, it.first, since_start ? "latency since start" : "latency", {
+                {"lines",    static_cast<double>(values.total)},
+                {"p50_us",   us(0.5)},
+                {"p99_us",   us(0.99)},
+                {"p999_us",  us(0.999)},
+                {"max_us",   static_cast<double>(values.max()) / 1000}
+        });
+    }
+}
+
+void cm::application::latency_timeout_handler(const boost::system::error_code &ec) {
+    if (ec == boost::asio::error::operation_aborted)
+        return;
+
+    report_latency(false);
+    start_latency_timer();
+}
+
+void cm::application::start_latency_timer() {
+    latency_timer.expires_from_now(map->latency_interval);
+    latency_timer.async_wait(boost::asio::bind_executor(control, [this](auto &ec) {
+        latency_timeout_handler(ec);
+    }));
 }
 
 void cm::application::setup_signal_set() {
@@ -1,11 +1,22 @@
 #ifndef CM_APPLICATION_H
 #define CM_APPLICATION_H
 
+#include <random>
 #include <boost/process.hpp>
 #include <boost/asio.hpp>
 #include "logger.h"
 #include "child.h"
 #include "config_map.h"
+#include "token_bucket.h"
+#include "restart_policy.h"
+#include "readiness_probe.h"
+#include "resource_sampler.h"
+#include "metrics.h"
+#include "control.h"
+#include "listen_socket.h"
+#include "reaper.h"
+#include "timing_wheel.h"
+#include "trace.h"
 
 namespace cm {
 
@@ -20,15 +31,88 @@ namespace cm {
 
         std::shared_ptr<logger> log;
         std::shared_ptr<config_map> map;
+        // configurations replaced by a reload. children and handlers of apps which didn't change keep
+        // referring to their app in the configuration they were started from, see hold()
+        std::vector<std::weak_ptr<config_map>> generations;
         boost::process::group proc_group;
         boost::asio::io_service ios;
+        // serializes signal handling, timers and exit handling
+        boost::asio::io_service::strand control;
+        std::unique_ptr<cm::reaper> reaper;
+        // runs of scheduled apps, on the control strand
+        timing_wheel schedules;
+        std::minstd_rand random{std::random_device()()};
+        buffer_pool pool;
+        std::unique_ptr<uring> ring;
+        std::unique_ptr<resource_sampler> sampler;
+        std::unique_ptr<metrics_server> metrics;
+        std::unique_ptr<control_server> ctl;
+        // sockets passed to the apps, they stay open across restarts and reloads. keyed by app and address,
+        // replicas share a unix socket, which is keyed by its path only
+        std::map<std::string, std::unique_ptr<listen_socket>> listeners;
         std::map<std::string, std::unique_ptr<child>> children;
-        application_line_buffer linebuffer;
+        // guards children and log_limits while apps are started in parallel
+        std::mutex children_mutex;
+        std::map<std::string, std::shared_ptr<token_bucket>> log_limits;
+
+        struct supervision {
+            restart_policy policy;
+            boost::asio::steady_timer restart_timer;
+            bool restart_pending = false;
+            // startup order, started is also set when a start failed for good
+            bool started = false, ready = false;
+            std::size_t waiting = 0;
+            std::vector<const config_map::configured_application *> dependents;
+            // shared with the output handlers of the children for log probes
+            std::shared_ptr<readiness_probe> probe;
+            app_metrics metrics;
+            // stopped by cm ctl, it stays down until started again
+            bool stopped = false, stop_requested = false, restart_requested = false;
+            // sent its term-signal by the shutdown, stop_timer runs
+            bool terminating = false;
+            // no longer configured after a reload, the entry stays for handlers of its last child. written
+            // on the control strand, also read when metrics are rendered
+            std::atomic_bool removed{false};
+            boost::asio::deadline_timer stop_timer;
+            // clients of cm ctl tail, tailed spares the output path the lock while there are none
+            std::mutex tail_mutex;
+            std::vector<std::shared_ptr<control_session>> tails;
+            std::atomic_bool tailed{false};
+            // when the app was asked to stop, for tracing how long it took
+            trace::clock::time_point terminated;
+            // latency histogram at the last latency record, the next one covers what came since
+            latency_histogram::snapshot latency_reported;
+            // runs as a job on a schedule: the next run, its time without jitter and runs waiting for
+            // the current one to finish
+            bool scheduled = false;
+            timing_wheel::handle next_run;
+            std::chrono::system_clock::time_point next_due;
+            std::size_t queued_runs = 0;
+
+            supervision(const config_map::configured_application &app, boost::asio::io_service &ios)
+                    : policy(app), restart_timer(ios), stop_timer(ios) {
+            }
+        };
+
+        std::map<std::string, supervision> supervised;
+        // children replaced by a restart, destroyed once their output is read up to EOF
+        std::vector<std::unique_ptr<child>> retired;
+        // probes replaced by a reload, destroyed once none of their handlers is in flight anymore
+        std::vector<std::shared_ptr<readiness_probe>> retired_probes;
+        std::size_t ready_apps = 0;
         boost::asio::deadline_timer kill_timer;
+        boost::asio::deadline_timer suppressed_timer;
+        bool reporting_suppressed = false;
+        // fixed at start like the other global settings, a reload doesn't change it
+        bool measuring_latency = false;
+        boost::asio::deadline_timer latency_timer;
         boost::asio::signal_set signal_set;
         int total_apps;
         std::atomic_int completed_apps;
         std::atomic_bool shutdown_running;
+        // set on the control strand by the first all_down_handler
+        bool all_down = false;
+        trace::clock::time_point shutdown_begin;
 
         void kill_timeout_handler(const boost::system::error_code &ec);;
 
@@ -36,6 +120,10 @@ namespace cm {
 
         void shutdown_handler();
 
+        void stop_next_tier();
+
+        void terminate_app(const config_map::configured_application &app, supervision &s);
+
         void signal_handler(const boost::system::error_code &ec, int signal_number);
 
         void setup_signal_set();
@@ -44,6 +132,94 @@ namespace cm {
 
         void setup_children();
 
+        void create_probe(const config_map::configured_application &app, supervision &s);
+
+        /**
+         * Cancels the app's probe, it is destroyed once its handlers are done.
+         */
+        void retire_probe(supervision &s);
+
+        /**
+         * Moves the app's child to the retired ones, it is destroyed once its output is read up to EOF.
+         */
+        void retire_child(const std::string &name);
+
+        /**
+         * The app was restarted by a reload which gave it dependencies that aren't ready. It starts over
+         * as if it was never started, ready_handler starts it once they are.
+         */
+        void await_dependencies(const config_map::configured_application &app, supervision &s);
+
+        const config_map::configured_application *current(const std::string &name) const;
+
+        /**
+         * Keeps the configuration app belongs to alive as long as the returned pointer. Handlers outliving
+         * the call capture it instead of a reference to the app, so a generation replaced by a reload is
+         * freed once its last child, timer and probe are gone.
+         */
+        [[nodiscard]] std::shared_ptr<const config_map::configured_application>
+        hold(const config_map::configured_application &app) const;
+
+        void reload_handler();
+
+        /**
+         * Binds the sockets of the configuration's apps which aren't open yet and closes the ones no app
+         * uses anymore. Throws std::system_error and leaves the open sockets as they were if one fails.
+         */
+        void open_listeners(const config_map &config);
+
+        [[nodiscard]] std::vector<int> listen_fds(const config_map::configured_application &app) const;
+
+        void start_child(const config_map::configured_application &app);
+
+        /**
+         * Starts the app, or its schedule if it has one.
+         */
+        void launch(const config_map::configured_application &app);
+
+        void schedule_app(const config_map::configured_application &app);
+
+        void arm_schedule(const config_map::configured_application &app);
+
+        void schedule_handler(const std::string &name);
+
+        void exit_handler(const config_map::configured_application &app, int exit_code);
+
+        void restart_timeout_handler(const config_map::configured_application &app,
+                                     const boost::system::error_code &ec);
+
+        void ready_handler(const config_map::configured_application &app);
+
+        void ready_timeout_handler(const config_map::configured_application &app);
+
+        void cancel_pending();
+
+        void render_metrics(std::string &out);
+
+        void control_handler(const std::vector<std::string> &request, const std::shared_ptr<control_session> &session);
+
+        std::string control_status();
+
+        std::string stop_app(const config_map::configured_application &app, bool restart);
+
+        std::string start_app(const config_map::configured_application &app);
+
+        void stop_timeout_handler(const config_map::configured_application &app, const boost::system::error_code &ec);
+
+        void tail(supervision &s, std::string_view line);
+
+        void report_suppressed();
+
+        void suppressed_timeout_handler(const boost::system::error_code &ec);
+
+        void start_suppressed_timer();
+
+        void report_latency(bool since_start);
+
+        void latency_timeout_handler(const boost::system::error_code &ec);
+
+        void start_latency_timer();
+
     };
 }
 
@@ -0,0 +1,417 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Runs cm with a number of cm-loadgen children and measures how it copes with their output:
+ * throughput, CPU time and peak RSS of cm itself, and the latency from the write of a line by a
+ * child to its arrival on the output of cm. Every run is printed as one JSON object per line on
+ * stdout, progress goes to stderr.
+ *
+ * The bench reads the output of cm through pipes, so the numbers include a reader which keeps up
+ * but not a terminal or a log shipper.
+ */
+
+extern char **environ;
+
+namespace {
+
+    struct scenario {
+        std::string name;
+        std::size_t size;
+        // total over all children, each gets its share
+        std::size_t lines;
+        double rate = 0;
+        std::size_t burst = 0;
+        long burst_interval_ms = 0;
+        unsigned stderr_percent = 0;
+        bool newline = true;
+    };
+
+    const std::vector<scenario> scenarios = {
+            {"small",     100,         400000},
+            {"large",     4096,        40000},
+            {"mixed",     100,         400000, 0,     0,    0, 50},
+            {"burst",     200,         200000, 0,     2000, 5},
+            {"paced",     100,         20000,  10000},
+            {"nonewline", 64 * 1024,   64,     0,     0,    0, 0, false},
+            {"long",      2 << 20,     16},
+    };
+
+    struct options {
+        std::string cm;
+        std::string loadgen;
+        std::vector<std::string> scenarios;
+        std::vector<std::size_t> children = {1, 4, 16};
+        std::vector<std::string> modes = {"s", "j"};
+        bool async = false;
+        double scale = 1;
+        int timeout = 60;
+    };
+
+    struct result {
+        std::size_t output_lines = 0, output_bytes = 0, marked_lines = 0, finished = 0;
+        double seconds = 0, cpu_seconds = 0;
+        long peak_rss_kb = 0;
+        std::vector<std::int64_t> latencies;
+        bool timeout = false;
+        int exit_status = 0;
+    };
+
+    std::int64_t now_ns() {
+        timespec ts{};
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    std::vector<std::string> split(const std::string &s, char separator) {
+        std::vector<std::string> parts;
+        std::istringstream is(s);
+        std::string part;
+        while (std::getline(is, part, separator))
+            if (!part.empty())
+                parts.push_back(part);
+        return parts;
+    }
+
+    std::string sibling(const char *argv0, const std::string &name) {
+        std::string self = argv0;
+        auto slash = self.rfind('/');
+        return slash == std::string::npos ? name : self.substr(0, slash + 1) + name;
+    }
+
+    // cm runs the load generator in the context of the app, a relative path would be resolved there
+    std::string absolute(const std::string &path) {
+        if (path.find('/') == std::string::npos)
+            return path;
+        char resolved[PATH_MAX];
+        return ::realpath(path.c_str(), resolved) ? resolved : path;
+    }
+
+    // user and system time of cm alone, the children it reaped aren't included
+    double cpu_seconds(pid_t pid) {
+        std::ifstream is("/proc/" + std::to_string(pid) + "/stat");
+        std::string stat((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        auto paren = stat.rfind(')');
+        if (paren == std::string::npos)
+            return 0;
+
+        // fields after the command, utime and stime are the 14th and 15th of the whole line
+        std::istringstream fields(stat.substr(paren + 2));
+        std::string field;
+        unsigned long long utime = 0, stime = 0;
+        for (int i = 3; i <= 15 && fields >> field; i++) {
+            if (i == 14)
+                utime = std::stoull(field);
+            else if (i == 15)
+                stime = std::stoull(field);
+        }
+        return static_cast<double>(utime + stime) / static_cast<double>(::sysconf(_SC_CLK_TCK));
+    }
+
+    long peak_rss_kb(pid_t pid) {
+        std::ifstream is("/proc/" + std::to_string(pid) + "/status");
+        std::string line;
+        while (std::getline(is, line))
+            if (line.rfind("VmHWM:", 0) == 0)
+                return std::atol(line.c_str() + 6);
+        return 0;
+    }
+
+    std::string write_config(const std::string &dir, const options &o, const scenario &s, std::size_t children) {
+        std::size_t lines = std::max<std::size_t>(1, static_cast<std::size_t>(s.lines * o.scale) / children);
+
+        std::ostringstream cmd;
+        cmd << o.loadgen << " --size " << s.size << " --lines " << lines;
+        if (s.rate > 0)
+            cmd << " --rate " << s.rate / static_cast<double>(children);
+        if (s.burst > 0)
+            cmd << " --burst " << s.burst << " --burst-interval " << s.burst_interval_ms;
+        if (s.stderr_percent > 0)
+            cmd << " --stderr " << s.stderr_percent;
+        if (!s.newline)
+            cmd << " --no-newline";
+
+        std::string file = dir + "/cm-bench.yaml";
+        std::ofstream os(file, std::ios::trunc);
+        os << "version: 1\n"
+           << "kill-delay: 1000\n"
+           << "log-async: " << (o.async ? "true" : "false") << "\n"
+           << "apps:\n";
+        for (std::size_t i = 0; i < children; i++)
+            os << "  gen" << i << ":\n"
+               << "    exec: " << cmd.str() << "\n"
+               << "    fail-on-exit: false\n"
+               << "    fail-on-nonzero-exit: false\n";
+        return file;
+    }
+
+    // every complete line, the position of a marker tells whether it's a stamped line or the end
+    void scan(std::string &buffer, std::int64_t arrived, result &r) {
+        std::size_t begin = 0;
+        for (;;) {
+            auto newline = buffer.find('\n', begin);
+            if (newline == std::string::npos)
+                break;
+
+            std::string_view line(buffer.data() + begin, newline - begin);
+            r.output_lines++;
+            r.output_bytes += line.size() + 1;
+
+            auto marker = line.find("@@");
+            if (marker != std::string_view::npos) {
+                auto rest = line.substr(marker + 2);
+                if (rest.rfind("END", 0) == 0) {
+                    r.finished++;
+                } else if (rest.size() >= 19) {
+                    std::int64_t written = 0;
+                    bool valid = true;
+                    for (std::size_t i = 0; i < 19 && valid; i++) {
+                        valid = rest[i] >= '0' && rest[i] <= '9';
+                        written = written * 10 + (rest[i] - '0');
+                    }
+                    if (valid) {
+                        r.marked_lines++;
+                        r.latencies.push_back(arrived - written);
+                    }
+                }
+            }
+            begin = newline + 1;
+        }
+        buffer.erase(0, begin);
+    }
+
+    result run(const options &o, const scenario &s, const std::string &mode, std::size_t children) {
+        result r;
+
+        char dir_template[] = "/tmp/cm-bench.XXXXXX";
+        const char *dir = ::mkdtemp(dir_template);
+        if (!dir)
+            throw std::runtime_error(std::string("can't create temporary directory: ") + std::strerror(errno));
+        std::string config = write_config(dir, o, s, children);
+
+        int out[2], err[2];
+        if (::pipe2(out, O_CLOEXEC) == -1 || ::pipe2(err, O_CLOEXEC) == -1)
+            throw std::runtime_error(std::string("can't create pipe: ") + std::strerror(errno));
+
+        posix_spawn_file_actions_t actions;
+        ::posix_spawn_file_actions_init(&actions);
+        ::posix_spawn_file_actions_adddup2(&actions, out[1], 1);
+        ::posix_spawn_file_actions_adddup2(&actions, err[1], 2);
+
+        std::string flag = "-" + mode;
+        char *argv[] = {const_cast<char *>(o.cm.c_str()), const_cast<char *>(flag.c_str()),
+                        const_cast<char *>(config.c_str()), nullptr};
+
+        auto start = now_ns();
+        pid_t pid;
+        int spawned = ::posix_spawn(&pid, o.cm.c_str(), &actions, nullptr, argv, environ);
+        ::posix_spawn_file_actions_destroy(&actions);
+        ::close(out[1]);
+        ::close(err[1]);
+        if (spawned != 0)
+            throw std::runtime_error("can't start " + o.cm + ": " + std::strerror(spawned));
+
+        std::vector<char> chunk(256 * 1024);
+        std::string buffers[2];
+        pollfd fds[2] = {{out[0], POLLIN, 0}, {err[0], POLLIN, 0}};
+        int open = 2;
+        bool terminated = false;
+
+        while (open > 0) {
+            // measured when the last child is done, before cm starts shutting down
+            if (!terminated && r.finished >= children) {
+                r.seconds = static_cast<double>(now_ns() - start) / 1e9;
+                r.cpu_seconds = cpu_seconds(pid);
+                r.peak_rss_kb = peak_rss_kb(pid);
+                ::kill(pid, SIGTERM);
+                terminated = true;
+            } else if (!terminated && now_ns() - start > static_cast<std::int64_t>(o.timeout) * 1000000000) {
+                r.seconds = static_cast<double>(now_ns() - start) / 1e9;
+                r.cpu_seconds = cpu_seconds(pid);
+                r.peak_rss_kb = peak_rss_kb(pid);
+                r.timeout = true;
+                ::kill(pid, SIGKILL);
+                terminated = true;
+            }
+
+            if (::poll(fds, 2, 100) == -1 && errno != EINTR)
+                break;
+
+            for (int i = 0; i < 2; i++) {
+                if (fds[i].fd == -1 || fds[i].revents == 0)
+                    continue;
+
+                ssize_t n = ::read(fds[i].fd, chunk.data(), chunk.size());
+                if (n > 0) {
+                    buffers[i].append(chunk.data(), n);
+                    scan(buffers[i], now_ns(), r);
+                } else if (n == 0 || errno != EINTR) {
+                    ::close(fds[i].fd);
+                    fds[i].fd = -1;
+                    open--;
+                }
+            }
+        }
+
+        int status = 0;
+        ::waitpid(pid, &status, 0);
+        r.exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+        ::unlink(config.c_str());
+        ::rmdir(dir);
+        return r;
+    }
+
+    double percentile(std::vector<std::int64_t> &values, double p) {
+        if (values.empty())
+            return 0;
+        auto at = values.begin() + static_cast<std::ptrdiff_t>(p * static_cast<double>(values.size() - 1));
+        std::nth_element(values.begin(), at, values.end());
+        return static_cast<double>(*at);
+    }
+
+    void print(const scenario &s, const std::string &mode, std::size_t children, const options &o, result &r) {
+        std::size_t per_child = std::max<std::size_t>(1, static_cast<std::size_t>(s.lines * o.scale) / children);
+        std::size_t input_lines = per_child * children;
+        std::size_t input_bytes = input_lines * (s.size + (s.newline ? 1 : 0));
+        double mb = static_cast<double>(input_bytes) / (1024 * 1024);
+        std::size_t lost = s.newline && r.marked_lines < input_lines ? input_lines - r.marked_lines : 0;
+
+        char line[1024];
+        std::snprintf(line, sizeof(line),
+                      "{\"scenario\":\"%s\",\"mode\":\"%s\",\"async\":%s,\"children\":%zu,\"line_size\":%zu,"
+                      "\"input_lines\":%zu,\"input_bytes\":%zu,\"output_lines\":%zu,\"output_bytes\":%zu,"
+                      "\"lost_lines\":%zu,\"seconds\":%.3f,\"mb_per_s\":%.2f,\"lines_per_s\":%.0f,"
+                      "\"cpu_seconds\":%.2f,\"cpu_ms_per_mb\":%.2f,\"peak_rss_kb\":%ld,"
+                      "\"latency_p50_us\":%.1f,\"latency_p99_us\":%.1f,\"latency_max_us\":%.1f,"
+                      "\"timeout\":%s,\"exit_status\":%d}",
+                      s.name.c_str(), mode.c_str(), o.async ? "true" : "false", children, s.size,
+                      input_lines, input_bytes, r.output_lines, r.output_bytes,
+                      lost, r.seconds, r.seconds > 0 ? mb / r.seconds : 0,
+                      r.seconds > 0 ? static_cast<double>(input_lines) / r.seconds : 0,
+                      r.cpu_seconds, mb > 0 ? r.cpu_seconds * 1000 / mb : 0, r.peak_rss_kb,
+                      percentile(r.latencies, 0.5) / 1000, percentile(r.latencies, 0.99) / 1000,
+                      percentile(r.latencies, 1) / 1000,
+                      r.timeout ? "true" : "false", r.exit_status);
+        std::cout << line << std::endl;
+    }
+
+    void show_help(const char *program_name) {
+        std::cout << "Usage: " << program_name << " [OPTION]...\n"
+                  << "Measures log throughput of cm with synthetic children, one JSON object per run.\n\n"
+                  << "  --cm PATH           cm to measure (cm next to " << program_name << ")\n"
+                  << "  --loadgen PATH      Load generator (cm-loadgen next to " << program_name << ")\n"
+                  << "  --scenario LIST     Comma separated scenarios to run (all)\n"
+                  << "  --children LIST     Comma separated numbers of children (1,4,16)\n"
+                  << "  --modes LIST        Output modes of cm, s and j (s,j)\n"
+                  << "  --async             Run cm with log-async\n"
+                  << "  --scale FACTOR      Multiply the number of lines of every scenario (1)\n"
+                  << "  --timeout SECONDS   Kill cm if a run takes longer (60)\n"
+                  << "  -h, --help          Show this help\n\n"
+                  << "Scenarios:\n";
+        for (const auto &s : scenarios) {
+            std::cout << "  " << s.name << ": " << s.lines << " lines of " << s.size << " bytes";
+            if (s.rate > 0)
+                std::cout << " at " << s.rate << " lines/s";
+            if (s.burst > 0)
+                std::cout << " in bursts of " << s.burst << " every " << s.burst_interval_ms << " ms";
+            if (s.stderr_percent > 0)
+                std::cout << ", " << s.stderr_percent << "% on stderr";
+            if (!s.newline)
+                std::cout << " without newline";
+            std::cout << "\n";
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    options o;
+    o.cm = sibling(argv[0], "cm");
+    o.loadgen = sibling(argv[0], "cm-loadgen");
+
+    for (int i = 1; i < argc; i++) {
+        std::string v = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (v == "--cm" && has_value)
+            o.cm = argv[++i];
+        else if (v == "--loadgen" && has_value)
+            o.loadgen = argv[++i];
+        else if (v == "--scenario" && has_value)
+            o.scenarios = split(argv[++i], ',');
+        else if (v == "--children" && has_value) {
+            o.children.clear();
+            for (const auto &c : split(argv[++i], ','))
+                o.children.push_back(std::max(1ul, std::stoul(c)));
+        } else if (v == "--modes" && has_value)
+            o.modes = split(argv[++i], ',');
+        else if (v == "--async")
+            o.async = true;
+        else if (v == "--scale" && has_value)
+            o.scale = std::stod(argv[++i]);
+        else if (v == "--timeout" && has_value)
+            o.timeout = std::stoi(argv[++i]);
+        else if (v == "-h" || v == "--help") {
+            show_help(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Invalid option: " << v << "\n";
+            return 1;
+        }
+    }
+
+    o.loadgen = absolute(o.loadgen);
+
+    for (const auto &mode : o.modes) {
+        if (mode != "s" && mode != "j") {
+            std::cerr << "Invalid mode: " << mode << "\n";
+            return 1;
+        }
+    }
+
+    std::vector<scenario> selected = o.scenarios.empty() ? scenarios : std::vector<scenario>();
+    for (const auto &name : o.scenarios) {
+        auto it = std::find_if(scenarios.begin(), scenarios.end(), [&](auto &s) { return s.name == name; });
+        if (it == scenarios.end()) {
+            std::cerr << "Unknown scenario: " << name << "\n";
+            return 1;
+        }
+        selected.push_back(*it);
+    }
+
+    // the children write into pipes of cm, a dying cm must not kill the bench
+    ::signal(SIGPIPE, SIG_IGN);
+
+    try {
+        for (const auto &s : selected) {
+            for (const auto &mode : o.modes) {
+                for (auto children : o.children) {
+                    std::cerr << s.name << " -" << mode << " " << children << " children\n";
+                    auto r = run(o, s, mode, children);
+                    print(s, mode, children, o, r);
+                }
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
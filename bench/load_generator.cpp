@@ -0,0 +1,160 @@
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+/*
+ * Synthetic child for cm-bench. Every line starts with a marker, the CLOCK_MONOTONIC time it was
+ * written in nanoseconds as 19 digits and a sequence number, cm-bench finds them in the output of cm:
+ *
+ *   @@<ns> <seq> xxxxxxxx...
+ *
+ * After the last line "@@END" is written on stdout, so the bench knows when a child is done.
+ */
+
+namespace {
+
+    struct options {
+        std::size_t size = 100;
+        std::size_t lines = 10000;
+        double rate = 0;
+        std::size_t burst = 0;
+        long burst_interval_ms = 0;
+        unsigned stderr_percent = 0;
+        bool newline = true;
+    };
+
+    // lines of an unthrottled generator are collected up to this size, cm has to be the bottleneck
+    const std::size_t batch_size = 64 * 1024;
+
+    const std::size_t stamp_digits = 19;
+
+    std::int64_t now_ns() {
+        timespec ts{};
+        ::clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    struct pending {
+        std::string data;
+        // positions of the timestamps, filled in right before the write
+        std::vector<std::size_t> stamps;
+    };
+
+    void write_all(int fd, const std::string &data) {
+        const char *p = data.data();
+        std::size_t left = data.size();
+        while (left > 0) {
+            ssize_t n = ::write(fd, p, left);
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                std::exit(1); // cm is gone
+            p += n;
+            left -= n;
+        }
+    }
+
+    void flush(int fd, pending &p) {
+        char digits[stamp_digits + 1];
+        std::snprintf(digits, sizeof(digits), "%019lld", static_cast<long long>(now_ns()));
+        for (auto at : p.stamps)
+            p.data.replace(at, stamp_digits, digits, stamp_digits);
+
+        write_all(fd, p.data);
+        p.data.clear();
+        p.stamps.clear();
+    }
+
+    void append_line(pending &p, std::size_t seq, const options &o) {
+        auto &out = p.data;
+        auto begin = out.size();
+        out.append("@@");
+        p.stamps.push_back(out.size());
+        out.append(stamp_digits, '0');
+        out.push_back(' ');
+        out.append(std::to_string(seq));
+        out.push_back(' ');
+        if (out.size() - begin < o.size)
+            out.append(o.size - (out.size() - begin), 'x');
+        if (o.newline)
+            out.push_back('\n');
+    }
+
+    void show_help(const char *program_name) {
+        std::cout << "Usage: " << program_name << " [OPTION]...\n"
+                  << "Writes synthetic log lines for cm-bench.\n\n"
+                  << "  --size BYTES        Length of a line without newline, at least the header (100)\n"
+                  << "  --lines N           Number of lines (10000)\n"
+                  << "  --rate N            Lines per second, 0 writes as fast as possible (0)\n"
+                  << "  --burst N           Write N lines back to back, then wait for --burst-interval\n"
+                  << "  --burst-interval MS Pause between bursts\n"
+                  << "  --stderr PERCENT    Share of lines written to stderr (0)\n"
+                  << "  --no-newline        Don't terminate lines, the output is one endless line\n";
+    }
+}
+
+int main(int argc, char *argv[]) {
+    options o;
+
+    for (int i = 1; i < argc; i++) {
+        std::string v = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (v == "--size" && has_value)
+            o.size = std::stoul(argv[++i]);
+        else if (v == "--lines" && has_value)
+            o.lines = std::stoul(argv[++i]);
+        else if (v == "--rate" && has_value)
+            o.rate = std::stod(argv[++i]);
+        else if (v == "--burst" && has_value)
+            o.burst = std::stoul(argv[++i]);
+        else if (v == "--burst-interval" && has_value)
+            o.burst_interval_ms = std::stol(argv[++i]);
+        else if (v == "--stderr" && has_value)
+            o.stderr_percent = std::min(100ul, std::stoul(argv[++i]));
+        else if (v == "--no-newline")
+            o.newline = false;
+        else if (v == "-h" || v == "--help") {
+            show_help(argv[0]);
+            return 0;
+        } else {
+            std::cerr << "Invalid option: " << v << "\n";
+            return 1;
+        }
+    }
+
+    ::signal(SIGPIPE, SIG_IGN);
+
+    // batching only when nothing waits between lines, paced and bursting lines are written one by one
+    bool batched = o.rate <= 0 && o.burst == 0;
+    pending out[2];
+    auto start = std::chrono::steady_clock::now();
+
+    for (std::size_t seq = 0; seq < o.lines; seq++) {
+        // spread evenly, 30% to stderr means 30 of every 100 lines
+        int stream = (seq % 100) < o.stderr_percent ? 1 : 0;
+        append_line(out[stream], seq, o);
+
+        if (!batched || out[stream].data.size() >= batch_size)
+            flush(stream + 1, out[stream]);
+
+        if (o.burst > 0 && (seq + 1) % o.burst == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(o.burst_interval_ms));
+        else if (o.rate > 0)
+            std::this_thread::sleep_until(start + std::chrono::duration<double>((seq + 1) / o.rate));
+    }
+
+    for (int stream = 0; stream < 2; stream++)
+        if (!out[stream].data.empty())
+            flush(stream + 1, out[stream]);
+
+    write_all(1, o.newline ? "@@END\n" : "\n@@END\n");
+    return 0;
+}
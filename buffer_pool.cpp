@@ -0,0 +1,70 @@
+#include "buffer_pool.h"
+
+cm::buffer_pool::slab::slab(buffer_pool *pool, std::unique_ptr<char[]> bytes, std::size_t length)
+        : pool(pool), bytes(std::move(bytes)), length(length) {
+}
+
+cm::buffer_pool::slab::slab(slab &&other) noexcept
+        : pool(other.pool), bytes(std::move(other.bytes)), length(other.length) {
+    other.length = 0;
+}
+
+cm::buffer_pool::slab &cm::buffer_pool::slab::operator=(slab &&other) noexcept {
+    if (this != &other) {
+        if (bytes)
+            pool->release(std::move(bytes), length);
+        pool = other.pool;
+        bytes = std::move(other.bytes);
+        length = other.length;
+        other.length = 0;
+    }
+    return *this;
+}
+
+cm::buffer_pool::slab::~slab() {
+    if (bytes)
+        pool->release(std::move(bytes), length);
+}
+
+cm::buffer_pool::buffer_pool(std::size_t max_free_per_size)
+        : max_free_per_size(max_free_per_size), free_slabs(size_class(max_slab_size) + 1) {
+}
+
+std::size_t cm::buffer_pool::size_class(std::size_t size) {
+    std::size_t c = 0;
+    for (std::size_t s = min_slab_size; s < size; s <<= 1)
+        c++;
+    return c;
+}
+
+cm::buffer_pool::slab cm::buffer_pool::acquire(std::size_t size) {
+
+    if (size > max_slab_size)
+        return slab(this, std::unique_ptr<char[]>(new char[size]), size);
+
+    std::size_t c = size_class(size);
+    std::size_t length = min_slab_size << c;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto &list = free_slabs[c];
+        if (!list.empty()) {
+            auto bytes = std::move(list.back());
+            list.pop_back();
+            return slab(this, std::move(bytes), length);
+        }
+    }
+
+    return slab(this, std::unique_ptr<char[]>(new char[length]), length);
+}
+
+void cm::buffer_pool::release(std::unique_ptr<char[]> bytes, std::size_t length) {
+
+    if (length > max_slab_size)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &list = free_slabs[size_class(length)];
+    if (list.size() < max_free_per_size)
+        list.push_back(std::move(bytes));
+}
@@ -0,0 +1,72 @@
+#ifndef CM_BUFFER_POOL_H
+#define CM_BUFFER_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cm {
+
+    /**
+     * Hands out read buffers (slabs) in power of two sizes and keeps a bounded number of
+     * returned slabs per size for reuse. Slabs return to the pool when they are destroyed.
+     */
+    class buffer_pool {
+
+    public:
+        static constexpr std::size_t min_slab_size = 4096;
+        static constexpr std::size_t max_slab_size = 256 * 1024;
+
+        class slab {
+
+        public:
+            slab() = default;
+
+            slab(slab &&other) noexcept;
+
+            slab &operator=(slab &&other) noexcept;
+
+            ~slab();
+
+            [[nodiscard]] char *data() const {
+                return bytes.get();
+            }
+
+            [[nodiscard]] std::size_t size() const {
+                return length;
+            }
+
+            explicit operator bool() const {
+                return bytes != nullptr;
+            }
+
+        private:
+            friend class buffer_pool;
+
+            slab(buffer_pool *pool, std::unique_ptr<char[]> bytes, std::size_t length);
+
+            buffer_pool *pool = nullptr;
+            std::unique_ptr<char[]> bytes;
+            std::size_t length = 0;
+        };
+
+        explicit buffer_pool(std::size_t max_free_per_size = 8);
+
+        /**
+         * Returns a slab of at least size bytes. Sizes above max_slab_size are allocated
+         * exactly and not kept for reuse.
+         */
+        slab acquire(std::size_t size);
+
+    private:
+        void release(std::unique_ptr<char[]> bytes, std::size_t length);
+
+        static std::size_t size_class(std::size_t size);
+
+        const std::size_t max_free_per_size;
+        std::mutex mutex;
+        std::vector<std::vector<std::unique_ptr<char[]>>> free_slabs;
+    };
+}
+
+#endif //CM_BUFFER_POOL_H
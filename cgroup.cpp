@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <sched.h>
+#include "cgroup.h"
+
+namespace {
+
+    bool read_v2_quota(double &cpus) {
+        std::ifstream f("/sys/fs/cgroup/cpu.max");
+        std::string quota;
+        double period = 0;
+
+        if (!(f >> quota >> period) || quota == "max" || period <= 0)
+            return false;
+
+        cpus = std::stod(quota) / period;
+        return true;
+    }
+
+    bool read_v1_quota(double &cpus) {
+        std::ifstream quota_file("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+        std::ifstream period_file("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+        double quota = 0, period = 0;
+
+        if (!(quota_file >> quota) || !(period_file >> period) || quota <= 0 || period <= 0)
+            return false;
+
+        cpus = quota / period;
+        return true;
+    }
+}
+
+unsigned cm::cgroup::cpu_limit() {
+
+    unsigned online = std::max(1u, std::thread::hardware_concurrency());
+    double cpus = 0;
+
+    if (read_v2_quota(cpus) || read_v1_quota(cpus))
+        return std::clamp(static_cast<unsigned>(std::ceil(cpus)), 1u, online);
+
+    return online;
+}
+
+std::vector<int> cm::cgroup::cpuset() {
+
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (::sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &set))
+                cpus.push_back(cpu);
+    }
+
+    if (cpus.empty())
+        for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++)
+            cpus.push_back(static_cast<int>(cpu));
+
+    return cpus;
+}
@@ -0,0 +1,20 @@
+#ifndef CM_CGROUP_H
+#define CM_CGROUP_H
+
+#include <vector>
+
+namespace cm::cgroup {
+
+    /**
+     * Returns the number of CPUs cm may use: the CFS quota of its cgroup (v2 or v1) rounded up,
+     * limited to the number of online CPUs. Falls back to the number of online CPUs without a quota.
+     */
+    unsigned cpu_limit();
+
+    /**
+     * Returns the CPUs cm may run on, i.e. the cpuset of its cgroup narrowed by its own affinity.
+     */
+    std::vector<int> cpuset();
+}
+
+#endif //CM_CGROUP_H
@@ -2,38 +2,83 @@
 // Created by jp on 1/13/20.
 //
 
+#include <cerrno>
+#include <fcntl.h>
 #include "child.h"
+#include "trace.h"
 
-cm::child::child(std::string name, const fs::path &executable, const std::vector<std::string> &args,
-                 const fs::path &context, const std::map<std::string, std::string> &env, int term_signal,
-                 asio::io_service &ios, bp::group &group)
-        : name(std::move(name)), out_pipe(ios), err_pipe(ios), in_pipe(ios), exited(false),
-          term_signal(term_signal) {
-    
-    auto boost_env = boost::this_process::environment();
+namespace {
+    const std::size_t drain_budget = 1024 * 1024;
+    const std::chrono::milliseconds backpressure_retry(10);
+}
 
-    for (const auto &it : env)
-        boost_env[it.first] = it.second;
+cm::child::child(std::string name, const spawn_block &spawn, const std::vector<int> &sockets, int term_signal,
+                 config_map::log_mode mode, const line_buffer::limits &limits,
+                 asio::io_service &ios, bp::group &group, reaper &reaper, buffer_pool &pool, uring *ring,
+                 app_metrics &metrics)
+        : name(std::move(name)), strand(ios), out_pipe(ios), err_pipe(ios), in_pipe(ios), exited(false),
+          term_signal(term_signal), out_resume(ios), err_resume(ios),
+          out_lines(pool, limits), err_lines(pool, limits), metrics(metrics) {
 
-    // WORKAROUND: executable.native() is used cause debian#libboost1.67-dev somehow
-    // patched out the assignment operators for fs::path to bp::exe
-    child_process = bp::child(bp::exe = executable.native(), bp::args = args, bp::start_dir = context,
-                              bp::env = bp::environment(boost_env),
-                              ios, group,
-                              bp::std_in < in_pipe, bp::std_out > out_pipe, bp::std_err > err_pipe,
-                              bp::on_exit = [this](const int exit, const std::error_code &ec) {
-                                  on_exit_handler(exit, ec);
-                              }
-    );
+    // executable, argv and envp come prebuilt from the spawn block. vfork spares copying the page
+    // tables of cm, the block's initializer has to stay last as it closes all fds above stderr and
+    // the listening sockets of the app
+    {
+        trace::span fork_exec("fork/exec", this->name);
+        std::optional<spawn_block::listen_fds> passed;
+        if (!sockets.empty())
+            passed.emplace(spawn, sockets);
+        auto spawning = reaper.spawning();
+        child_process = bp::child(ios, group,
+                                  bp::std_in < in_pipe, bp::std_out > out_pipe, bp::std_err > err_pipe,
+                                  bp::posix::use_vfork,
+                                  spawn_block::initializer(spawn, passed ? &*passed : nullptr)
+        );
+        // the reaper collects the exit, boost.process must not wait for the pid or kill it on destruction
+        child_process.detach();
+        reaper.watch(child_process.id(), [this](const int exit, const std::error_code &ec) {
+            on_exit_handler(exit, ec);
+        });
+    }
 
-    listen_stdout();
-    listen_stderr();
+    if (mode == config_map::log_mode::RAW) {
+        out_raw = std::make_unique<raw_stream>(ios, out_pipe.native_source(), STDOUT_FILENO, metrics.out);
+        err_raw = std::make_unique<raw_stream>(ios, err_pipe.native_source(), STDERR_FILENO, metrics.err);
+        out_raw->start();
+        err_raw->start();
+    } else if (ring) {
+        out_uring = std::make_unique<uring_stream>(*ring, out_pipe.native_source(), strand, out_lines, out_cb,
+                                                   metrics.out);
+        err_uring = std::make_unique<uring_stream>(*ring, err_pipe.native_source(), strand, err_lines, err_cb,
+                                                   metrics.err);
+        out_uring->start();
+        err_uring->start();
+    } else {
+        ::fcntl(out_pipe.native_source(), F_SETFL, ::fcntl(out_pipe.native_source(), F_GETFL) | O_NONBLOCK);
+        ::fcntl(err_pipe.native_source(), F_SETFL, ::fcntl(err_pipe.native_source(), F_GETFL) | O_NONBLOCK);
+        listen_stdout();
+        listen_stderr();
+    }
 }
 
 bool cm::child::terminated() {
     return exited.load();
 }
 
+bool cm::child::finished() {
+    if (!exited.load())
+        return false;
+    if (out_raw)
+        return out_raw->finished() && err_raw->finished();
+    if (out_uring)
+        return out_uring->finished() && err_uring->finished();
+    return out_closed.load() && err_closed.load();
+}
+
+int cm::child::pid() {
+    return child_process.native_handle();
+}
+
 void cm::child::terminate() {
     int pid = child_process.native_handle();
     ::kill(pid, term_signal);
@@ -44,6 +89,35 @@ void cm::child::kill() {
     ::kill(pid, SIGKILL);
 }
 
+int cm::child::send_signal(int signal_number) {
+    int pid = child_process.native_handle();
+    return ::kill(pid, signal_number) == -1 ? errno : 0;
+}
+
+void cm::child::close_output() {
+    if (out_raw) {
+        out_raw->stop();
+        err_raw->stop();
+        return;
+    }
+
+    if (out_uring) {
+        out_uring->stop();
+        err_uring->stop();
+        return;
+    }
+
+    // a wait in flight completes with an error, one which already completed sees closing
+    asio::post(strand, [this]() {
+        boost::system::error_code ignored;
+        closing = true;
+        out_pipe.cancel();
+        err_pipe.cancel();
+        out_resume.cancel(ignored);
+        err_resume.cancel(ignored);
+    });
+}
+
 void cm::child::set_on_exit(const cm::child::exit_callback_type &t) {
     exit_cb = t;
 }
@@ -57,32 +131,132 @@ void cm::child::set_on_stderr(const cm::child::read_callback_type &t) {
 }
 
 void cm::child::on_exit_handler(const int exit, const std::error_code &ec) {
-    exited.store(true);
-    exit_cb(exit, ec);
+    asio::post(strand, [this, exit, ec]() {
+        exited.store(true);
+        exit_cb(exit, ec);
+    });
 }
 
 void cm::child::listen_stdout() {
-    if (!exited.load())
-        asio::async_read(out_pipe, asio::buffer(out_buf),
-                         boost::asio::transfer_at_least(1),
-                         [this](const boost::system::error_code &ec, std::size_t len) {
-                             stream_content_type data(len);
-                             std::copy(out_buf.begin(), out_buf.begin() + len, data.begin());
-                             out_cb(data);
-
-                             listen_stdout();
-                         });
+    out_pipe.async_read_some(asio::null_buffers(), asio::bind_executor(
+            strand, [this](const boost::system::error_code &ec, std::size_t) { read_stdout(ec); }));
 }
 
 void cm::child::listen_stderr() {
-    if (!exited.load())
-        asio::async_read(err_pipe, asio::buffer(err_buf),
-                         boost::asio::transfer_at_least(1),
-                         [this](const boost::system::error_code &ec, std::size_t len) {
-                             std::vector<char> data(len);
-                             std::copy(err_buf.begin(), err_buf.begin() + len, data.begin());
-                             err_cb(data);
-
-                             listen_stderr();
-                         });
+    err_pipe.async_read_some(asio::null_buffers(), asio::bind_executor(
+            strand, [this](const boost::system::error_code &ec, std::size_t) { read_stderr(ec); }));
+}
+
+void cm::child::read_stdout(const boost::system::error_code &ec) {
+    if (closing) {
+        drain_rest(out_pipe, out_lines, out_cb, metrics.out);
+        out_closed = true;
+        return;
+    }
+
+    if (ec) {
+        out_lines.flush(out_cb);
+        out_closed = true;
+        return;
+    }
+
+    switch (drain(out_pipe, out_lines, out_cb, metrics.out)) {
+        case read_state::OPEN:
+            listen_stdout();
+            break;
+        case read_state::PAUSED:
+            out_resume.expires_after(backpressure_retry);
+            out_resume.async_wait(asio::bind_executor(
+                    strand, [this](const boost::system::error_code &ec) { read_stdout(ec); }));
+            break;
+        case read_state::CLOSED:
+            out_closed = true;
+            break;
+    }
+}
+
+void cm::child::read_stderr(const boost::system::error_code &ec) {
+    if (closing) {
+        drain_rest(err_pipe, err_lines, err_cb, metrics.err);
+        err_closed = true;
+        return;
+    }
+
+    if (ec) {
+        err_lines.flush(err_cb);
+        err_closed = true;
+        return;
+    }
+
+    switch (drain(err_pipe, err_lines, err_cb, metrics.err)) {
+        case read_state::OPEN:
+            listen_stderr();
+            break;
+        case read_state::PAUSED:
+            err_resume.expires_after(backpressure_retry);
+            err_resume.async_wait(asio::bind_executor(
+                    strand, [this](const boost::system::error_code &ec) { read_stderr(ec); }));
+            break;
+        case read_state::CLOSED:
+            err_closed = true;
+            break;
+    }
+}
+
+cm::child::read_state cm::child::drain(bp::async_pipe &pipe, line_buffer &lines, const read_callback_type &cb,
+                                       stream_metrics &metrics) {
+
+    // lines held back by the consumer go first. while it refuses lines the pipe isn't read
+    // anymore, so the child blocks once the pipe is full
+    if (!lines.commit(0, cb))
+        return read_state::PAUSED;
+
+    // reads until the pipe is empty, but yields to other children after drain_budget bytes
+    std::size_t budget = drain_budget;
+
+    while (budget > 0) {
+        auto buf = lines.prepare();
+        ssize_t n = ::read(pipe.native_source(), buf.data(), buf.size());
+
+        if (n > 0) {
+            metrics.read(n);
+            if (!lines.commit(n, cb))
+                return read_state::PAUSED;
+            budget -= std::min(budget, static_cast<std::size_t>(n));
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && errno == EAGAIN) {
+            lines.release_if_empty();
+            return read_state::OPEN;
+        } else {
+            lines.flush(cb);
+            return read_state::CLOSED;
+        }
+    }
+
+    return read_state::OPEN;
+}
+
+void cm::child::drain_rest(bp::async_pipe &pipe, line_buffer &lines, const read_callback_type &cb,
+                           stream_metrics &metrics) {
+
+    // no more backpressure, every line still buffered or in the pipe goes out now
+    while (!lines.commit(0, cb));
+
+    while (true) {
+        auto buf = lines.prepare();
+        ssize_t n = ::read(pipe.native_source(), buf.data(), buf.size());
+
+        if (n > 0) {
+            metrics.read(n);
+            if (!lines.commit(n, cb))
+                while (!lines.commit(0, cb));
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            break;
+        }
+    }
+
+    lines.flush(cb);
 }
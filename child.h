@@ -1,7 +1,6 @@
 #ifndef CM_CHILD_H
 #define CM_CHILD_H
 
-#include <array>
 #include <vector>
 #include <functional>
 #include <atomic>
@@ -10,7 +9,12 @@
 #include <boost/process.hpp>
 #include <boost/asio.hpp>
 #include <iostream>
+#include "config_map.h"
 #include "line_buffer.h"
+#include "raw_stream.h"
+#include "uring.h"
+#include "metrics.h"
+#include "reaper.h"
 
 namespace fs = boost::filesystem;
 namespace asio = boost::asio;
@@ -22,22 +26,39 @@ namespace cm {
 
         child(const child &) = delete;
 
-        typedef std::array<char, 4096> buffer_type;
-        typedef std::vector<char> stream_content_type;
-        typedef std::function<void(const stream_content_type &)> read_callback_type;
+        typedef line_buffer::line_callback_type read_callback_type;
         typedef std::function<void(const int, const std::error_code &)> exit_callback_type;
 
-        child(std::string name, const fs::path &executable, const std::vector<std::string> &args,
-              const fs::path &context,
-              const std::map<std::string, std::string> &env, int term_signal,
-              asio::io_service &ios, bp::group &group);
+        child(std::string name, const spawn_block &spawn, const std::vector<int> &sockets, int term_signal,
+              config_map::log_mode mode, const line_buffer::limits &limits,
+              asio::io_service &ios, bp::group &group, reaper &reaper, buffer_pool &pool, uring *ring,
+              app_metrics &metrics);
 
         bool terminated();
 
+        /**
+         * True once the process exited and its output was read up to EOF. Only then the child
+         * may be destroyed, before its streams still have handlers in flight.
+         */
+        bool finished();
+
+        int pid();
+
         void terminate();
 
         void kill();
 
+        /**
+         * Returns 0 or the errno of kill.
+         */
+        int send_signal(int signal_number);
+
+        /**
+         * Reads what the exited process left in its pipes and stops reading them instead of waiting
+         * for EOF, which doesn't come while a process it started still holds them open.
+         */
+        void close_output();
+
         void set_on_exit(const exit_callback_type &t);
 
         void set_on_stdout(const read_callback_type &t);
@@ -51,21 +72,42 @@ namespace cm {
 
         void listen_stderr();
 
+        void read_stdout(const boost::system::error_code &ec);
+
+        void read_stderr(const boost::system::error_code &ec);
+
+        enum class read_state {
+            OPEN, PAUSED, CLOSED
+        };
+
+        read_state drain(bp::async_pipe &pipe, line_buffer &lines, const read_callback_type &cb,
+                         stream_metrics &metrics);
+
+        void drain_rest(bp::async_pipe &pipe, line_buffer &lines, const read_callback_type &cb,
+                        stream_metrics &metrics);
+
     private:
         std::string name;
+        // serializes all handlers of this child, children are handled in parallel
+        asio::io_service::strand strand;
         bp::async_pipe out_pipe, err_pipe, in_pipe;
         bp::child child_process{};
 
         std::atomic_bool exited;
+        std::atomic_bool out_closed{false}, err_closed{false};
+        // set by close_output, on the strand
+        bool closing = false;
 
         int term_signal;
         read_callback_type out_cb, err_cb;
         exit_callback_type exit_cb;
-        buffer_type out_buf{}, err_buf{};
+        asio::steady_timer out_resume, err_resume;
+        line_buffer out_lines, err_lines;
+        app_metrics &metrics;
+        std::unique_ptr<raw_stream> out_raw, err_raw;
+        std::unique_ptr<uring_stream> out_uring, err_uring;
     };
 
-    typedef line_buffer<child::stream_content_type> application_line_buffer;
-
 }
 
 
@@ -1,13 +1,63 @@
 #include <iostream>
+#include <regex>
+#include <set>
+#include <unistd.h>
+#include <boost/algorithm/string/trim.hpp>
 #include "config_map.h"
 #include "constants.h"
+#include "cgroup.h"
+#include "listen_socket.h"
+#include "trace.h"
+
+namespace {
+
+    // cpu lists as in cpuset.cpus, e.g. 0-3,6
+    std::vector<int> parse_cpu_list(const std::string &app, const std::string &list) {
+        std::vector<int> cpus;
+        std::vector<std::string> ranges;
+        boost::split(ranges, list, boost::is_any_of(","));
+
+        for (const auto &range : ranges) {
+            auto dash = range.find('-');
+            try {
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                if (first < 0 || last < first || last >= CPU_SETSIZE)
+                    throw std::out_of_range(range);
+                for (int cpu = first; cpu <= last; cpu++)
+                    cpus.push_back(cpu);
+            } catch (const std::logic_error &) {
+                throw cm::config_map_exception("app " + app + " has invalid cpu-affinity " + list);
+            }
+        }
+
+        return cpus;
+    }
+
+    void split_command(const std::string &command, std::string &executable, std::vector<std::string> &args) {
+        boost::tokenizer<boost::escaped_list_separator<char>> tokenizer(
+                command, boost::escaped_list_separator<char>('\\', ' ', '\"')
+        );
+
+        auto it = tokenizer.begin();
+        executable = *tokenizer.begin();
+
+        it++;
+        for (; it != tokenizer.end(); it++) {
+            args.push_back(*it);
+        }
+    }
+}
 
 std::shared_ptr<cm::config_map> cm::config_map::from_file(const std::string &file) {
 
+    if (auto snapshot = load_snapshot(file))
+        return snapshot;
 
     auto map = std::make_shared<cm::config_map>(10000);
 
     try {
+        trace::span parse("parse yaml", file);
         auto config = YAML::LoadFile(file);
 
         if (!config["version"])
@@ -20,9 +70,16 @@ std::shared_ptr<cm::config_map> cm::config_map::from_file(const std::string &fil
         throw config_map_exception(e.what());
     }
 
+    map->source = file;
+    map->resolve_apps();
+
     return map;
 }
 
+std::shared_ptr<cm::config_map> cm::config_map::reload() const {
+    return source.empty() ? from_environment() : from_file(source);
+}
+
 cm::config_map::config_map(int kill_delay)
         : kill_delay(kill_delay) {
 }
@@ -35,21 +92,8 @@ cm::config_map::configured_application cm::config_map::parse_v1_app(const std::s
 
     if (!node["exec"])
         throw config_map_exception("app " + name + " requires exec key");
-    if (node["exec"].IsScalar()) {
-        auto s = node["exec"].as<std::string>();
-
-        boost::tokenizer<boost::escaped_list_separator<char>> tokenizer(
-                s, boost::escaped_list_separator<char>('\\', ' ', '\"')
-        );
-
-        auto it = tokenizer.begin();
-        n.executable = *tokenizer.begin();
-
-        it++;
-        for (; it != tokenizer.end(); it++) {
-            n.args.push_back(*it);
-        }
-    }
+    if (node["exec"].IsScalar())
+        split_command(node["exec"].as<std::string>(), n.executable, n.args);
 
     if (!node["context"])
         n.context = "/";
@@ -76,6 +120,288 @@ cm::config_map::configured_application cm::config_map::parse_v1_app(const std::s
     else
         n.term_signal = SIGTERM;
 
+    auto &stop_timeout_node = node["stop-timeout"];
+    if (stop_timeout_node && stop_timeout_node.IsScalar())
+        n.stop_timeout = boost::posix_time::milliseconds(stop_timeout_node.as<unsigned>());
+
+    auto &log_mode_node = node["log-mode"];
+    if (log_mode_node && log_mode_node.IsScalar()) {
+        auto mode = boost::to_lower_copy(log_mode_node.as<std::string>());
+        if (mode == "line")
+            n.mode = log_mode::LINE;
+        else if (mode == "raw")
+            n.mode = log_mode::RAW;
+        else
+            throw config_map_exception("app " + name + " has invalid log-mode " + mode);
+    }
+
+    auto &max_line_length_node = node["max-line-length"];
+    if (max_line_length_node && max_line_length_node.IsScalar())
+        n.max_line_length = max_line_length_node.as<std::size_t>();
+
+    auto &max_buffered_bytes_node = node["max-buffered-bytes"];
+    if (max_buffered_bytes_node && max_buffered_bytes_node.IsScalar())
+        n.max_buffered_bytes = max_buffered_bytes_node.as<std::size_t>();
+
+    if (n.max_line_length == 0)
+        throw config_map_exception("app " + name + " max-line-length must be greater than 0");
+    if (n.max_buffered_bytes <= n.max_line_length)
+        throw config_map_exception("app " + name + " max-buffered-bytes must be greater than max-line-length");
+
+    auto &long_lines_node = node["long-lines"];
+    if (long_lines_node && long_lines_node.IsScalar()) {
+        auto long_lines = boost::to_lower_copy(long_lines_node.as<std::string>());
+        if (long_lines == "split")
+            n.truncate_long_lines = false;
+        else if (long_lines == "truncate")
+            n.truncate_long_lines = true;
+        else
+            throw config_map_exception("app " + name + " has invalid long-lines " + long_lines);
+    }
+
+    auto &log_rate_node = node["log-rate"];
+    if (log_rate_node && log_rate_node.IsScalar())
+        n.log_rate = log_rate_node.as<double>();
+
+    auto &log_burst_node = node["log-burst"];
+    if (log_burst_node && log_burst_node.IsScalar())
+        n.log_burst = log_burst_node.as<double>();
+    else
+        n.log_burst = n.log_rate;
+
+    if (n.log_rate < 0)
+        throw config_map_exception("app " + name + " log-rate must not be negative");
+    if (n.log_rate > 0 && n.log_burst < 1)
+        throw config_map_exception("app " + name + " log-burst must be at least 1");
+
+    auto &restart_node = node["restart"];
+    if (restart_node && restart_node.IsScalar()) {
+        auto restart = boost::to_lower_copy(restart_node.as<std::string>());
+        if (restart == "never")
+            n.restart = restart_mode::NEVER;
+        else if (restart == "on-failure")
+            n.restart = restart_mode::ON_FAILURE;
+        else if (restart == "always")
+            n.restart = restart_mode::ALWAYS;
+        else
+            throw config_map_exception("app " + name + " has invalid restart " + restart);
+    }
+
+    auto &restart_delay_node = node["restart-delay"];
+    if (restart_delay_node && restart_delay_node.IsScalar())
+        n.restart_delay = boost::posix_time::milliseconds(restart_delay_node.as<unsigned>());
+
+    auto &restart_max_delay_node = node["restart-max-delay"];
+    if (restart_max_delay_node && restart_max_delay_node.IsScalar())
+        n.restart_max_delay = boost::posix_time::milliseconds(restart_max_delay_node.as<unsigned>());
+
+    if (n.restart_max_delay < n.restart_delay)
+        throw config_map_exception("app " + name + " restart-max-delay must not be less than restart-delay");
+
+    auto &restart_limit_node = node["restart-limit"];
+    if (restart_limit_node && restart_limit_node.IsScalar())
+        n.restart_limit = restart_limit_node.as<unsigned>();
+
+    auto &restart_window_node = node["restart-window"];
+    if (restart_window_node && restart_window_node.IsScalar()) {
+        n.restart_window = boost::posix_time::milliseconds(restart_window_node.as<unsigned>());
+        if (n.restart_window.total_milliseconds() == 0)
+            throw config_map_exception("app " + name + " restart-window must be greater than 0");
+    }
+
+    auto &schedule_node = node["schedule"];
+    if (schedule_node && schedule_node.IsScalar()) {
+        try {
+            n.schedule = cron_schedule(schedule_node.as<std::string>());
+        } catch (const std::invalid_argument &e) {
+            throw config_map_exception("app " + name + " has invalid schedule: " + e.what());
+        }
+    }
+
+    auto &schedule_overlap_node = node["schedule-overlap"];
+    if (schedule_overlap_node && schedule_overlap_node.IsScalar()) {
+        auto overlap = boost::to_lower_copy(schedule_overlap_node.as<std::string>());
+        if (overlap == "skip")
+            n.overlap = overlap_policy::SKIP;
+        else if (overlap == "queue")
+            n.overlap = overlap_policy::QUEUE;
+        else if (overlap == "kill")
+            n.overlap = overlap_policy::KILL;
+        else
+            throw config_map_exception("app " + name + " has invalid schedule-overlap " + overlap);
+    }
+
+    auto &schedule_jitter_node = node["schedule-jitter"];
+    if (schedule_jitter_node && schedule_jitter_node.IsScalar())
+        n.schedule_jitter = boost::posix_time::milliseconds(schedule_jitter_node.as<unsigned>());
+
+    if (n.schedule && n.restart != restart_mode::NEVER)
+        throw config_map_exception("app " + name + " has a schedule, restart doesn't apply to it");
+
+    auto &replicas_node = node["replicas"];
+    if (replicas_node && replicas_node.IsScalar()) {
+        n.replicas = replicas_node.as<unsigned>();
+        if (n.replicas == 0)
+            throw config_map_exception("app " + name + " replicas must be greater than 0");
+    }
+
+    auto &cpu_affinity_node = node["cpu-affinity"];
+    if (cpu_affinity_node && cpu_affinity_node.IsSequence()) {
+        for (const auto &cpu : cpu_affinity_node) {
+            n.sched.cpus.push_back(cpu.as<int>());
+            if (n.sched.cpus.back() < 0 || n.sched.cpus.back() >= CPU_SETSIZE)
+                throw config_map_exception("app " + name + " has invalid cpu " + cpu.as<std::string>());
+        }
+    } else if (cpu_affinity_node && cpu_affinity_node.IsScalar()) {
+        auto affinity = boost::to_lower_copy(cpu_affinity_node.as<std::string>());
+        if (affinity == "auto")
+            n.auto_affinity = true;
+        else
+            n.sched.cpus = parse_cpu_list(name, affinity);
+    }
+
+    auto &nice_node = node["nice"];
+    if (nice_node && nice_node.IsScalar()) {
+        n.sched.nice = nice_node.as<int>();
+        if (*n.sched.nice < -20 || *n.sched.nice > 19)
+            throw config_map_exception("app " + name + " nice must be between -20 and 19");
+    }
+
+    auto &sched_policy_node = node["sched-policy"];
+    if (sched_policy_node && sched_policy_node.IsScalar()) {
+        auto policy = boost::to_lower_copy(sched_policy_node.as<std::string>());
+        if (policy == "other")
+            n.sched.policy = SCHED_OTHER;
+        else if (policy == "batch")
+            n.sched.policy = SCHED_BATCH;
+        else if (policy == "idle")
+            n.sched.policy = SCHED_IDLE;
+        else if (policy == "fifo")
+            n.sched.policy = SCHED_FIFO;
+        else if (policy == "rr")
+            n.sched.policy = SCHED_RR;
+        else
+            throw config_map_exception("app " + name + " has invalid sched-policy " + policy);
+    }
+
+    bool realtime = n.sched.policy == SCHED_FIFO || n.sched.policy == SCHED_RR;
+
+    auto &sched_priority_node = node["sched-priority"];
+    if (sched_priority_node && sched_priority_node.IsScalar())
+        n.sched.priority = sched_priority_node.as<int>();
+    else if (realtime)
+        n.sched.priority = 1;
+
+    if (realtime && (n.sched.priority < 1 || n.sched.priority > 99))
+        throw config_map_exception("app " + name + " sched-priority must be between 1 and 99");
+    if (!realtime && n.sched.priority != 0)
+        throw config_map_exception("app " + name + " sched-priority requires sched-policy fifo or rr");
+
+    auto &io_priority_node = node["io-priority"];
+    if (io_priority_node && io_priority_node.IsScalar()) {
+        auto priority = boost::to_lower_copy(io_priority_node.as<std::string>());
+        auto colon = priority.find(':');
+        auto io_class = priority.substr(0, colon);
+
+        // IOPRIO_CLASS_* of linux/ioprio.h
+        if (io_class == "rt")
+            n.sched.io_class = 1;
+        else if (io_class == "be")
+            n.sched.io_class = 2;
+        else if (io_class == "idle")
+            n.sched.io_class = 3;
+        else
+            throw config_map_exception("app " + name + " has invalid io-priority " + priority);
+
+        if (colon != std::string::npos) {
+            try {
+                n.sched.io_level = std::stoi(priority.substr(colon + 1));
+            } catch (const std::logic_error &) {
+                n.sched.io_level = -1;
+            }
+        } else if (io_class != "idle") {
+            n.sched.io_level = 4;
+        }
+
+        if (n.sched.io_level < 0 || n.sched.io_level > 7 || (io_class == "idle" && n.sched.io_level != 0))
+            throw config_map_exception("app " + name + " has invalid io-priority " + priority);
+    }
+
+    auto &listen_node = node["listen"];
+    if (listen_node && listen_node.IsSequence()) {
+        for (const auto &address : listen_node)
+            n.listen.push_back(address.as<std::string>());
+    } else if (listen_node && listen_node.IsScalar()) {
+        boost::split(n.listen, listen_node.as<std::string>(), boost::is_any_of(","));
+        for (auto &address : n.listen)
+            boost::trim(address);
+    }
+
+    for (auto it = n.listen.begin(); it != n.listen.end(); it++) {
+        try {
+            listen_socket::validate(*it);
+        } catch (const std::invalid_argument &e) {
+            throw config_map_exception("app " + name + " has invalid listen: " + e.what());
+        }
+        if (std::find(n.listen.begin(), it, *it) != it)
+            throw config_map_exception("app " + name + " listens on " + *it + " twice");
+    }
+
+    auto &depends_on_node = node["depends-on"];
+    if (depends_on_node && depends_on_node.IsSequence()) {
+        for (const auto &dependency : depends_on_node)
+            n.depends_on.push_back(dependency.as<std::string>());
+    } else if (depends_on_node && depends_on_node.IsScalar()) {
+        boost::split(n.depends_on, depends_on_node.as<std::string>(), boost::is_any_of(","));
+    }
+
+    auto &ready_when_node = node["ready-when"];
+    if (ready_when_node && ready_when_node.IsMap()) {
+        if (ready_when_node.size() != 1)
+            throw config_map_exception("app " + name + " ready-when needs exactly one of port, file, exec or log");
+
+        auto kind = ready_when_node.begin()->first.as<std::string>();
+        auto value = ready_when_node.begin()->second;
+
+        if (!value.IsScalar())
+            throw config_map_exception("app " + name + " ready-when " + kind + " needs to be scalar");
+
+        if (kind == "port") {
+            n.ready = ready_probe::PORT;
+            n.ready_port = value.as<unsigned short>();
+        } else if (kind == "file") {
+            n.ready = ready_probe::FILE;
+            n.ready_target = value.as<std::string>();
+        } else if (kind == "exec") {
+            n.ready = ready_probe::EXEC;
+            split_command(value.as<std::string>(), n.ready_target, n.ready_args);
+        } else if (kind == "log") {
+            n.ready = ready_probe::LOG;
+            n.ready_target = value.as<std::string>();
+            try {
+                std::regex pattern(n.ready_target);
+            } catch (const std::regex_error &e) {
+                throw config_map_exception("app " + name + " has invalid ready-when log pattern: " + e.what());
+            }
+        } else {
+            throw config_map_exception("app " + name + " has invalid ready-when " + kind);
+        }
+    }
+
+    if (n.schedule && n.ready != ready_probe::NONE)
+        throw config_map_exception("app " + name + " has a schedule, ready-when doesn't apply to it");
+
+    auto &ready_interval_node = node["ready-interval"];
+    if (ready_interval_node && ready_interval_node.IsScalar()) {
+        n.ready_interval = boost::posix_time::milliseconds(ready_interval_node.as<unsigned>());
+        if (n.ready_interval.total_milliseconds() == 0)
+            throw config_map_exception("app " + name + " ready-interval must be greater than 0");
+    }
+
+    auto &ready_timeout_node = node["ready-timeout"];
+    if (ready_timeout_node && ready_timeout_node.IsScalar())
+        n.ready_timeout = boost::posix_time::milliseconds(ready_timeout_node.as<unsigned>());
+
     if (node["env"] && node["env"].IsMap()) {
         for (auto it = node["env"].begin(); it != node["env"].end(); it++) {
             auto k = it->first.as<std::string>();
@@ -94,6 +420,8 @@ cm::config_map::configured_application cm::config_map::parse_v1_app(const std::s
 
 void cm::config_map::parse_v1(const YAML::Node &config) {
 
+    std::map<std::string, std::vector<std::string>> replica_names;
+
     auto apps_k = config["apps"];
 
     if (!apps_k)
@@ -105,13 +433,273 @@ void cm::config_map::parse_v1(const YAML::Node &config) {
     if (kill_delay_l && kill_delay_l.IsScalar())
         kill_delay = boost::posix_time::milliseconds(kill_delay_l.as<int>());
 
+    auto threads_l = config["threads"];
+    if (threads_l && threads_l.IsScalar())
+        threads = threads_l.as<unsigned>();
+
+    auto spawn_threads_l = config["spawn-threads"];
+    if (spawn_threads_l && spawn_threads_l.IsScalar()) {
+        spawn_threads = spawn_threads_l.as<unsigned>();
+        if (spawn_threads == 0)
+            throw config_map_exception("spawn-threads must be greater than 0");
+    }
+
+    auto io_engine_l = config["io-engine"];
+    if (io_engine_l && io_engine_l.IsScalar()) {
+        auto e = boost::to_lower_copy(io_engine_l.as<std::string>());
+        if (e == "epoll")
+            engine = io_engine::EPOLL;
+        else if (e == "io_uring")
+            engine = io_engine::IO_URING;
+        else
+            throw config_map_exception("invalid io-engine " + e);
+    }
+
+    auto reap_orphans_l = config["reap-orphans"];
+    if (reap_orphans_l && reap_orphans_l.IsScalar()) {
+        auto o = boost::to_lower_copy(reap_orphans_l.as<std::string>());
+        if (o == "auto")
+            orphans = orphan_mode::AUTO;
+        else if (o == "subreaper")
+            orphans = orphan_mode::SUBREAPER;
+        else if (o == "off")
+            orphans = orphan_mode::OFF;
+        else
+            throw config_map_exception("invalid reap-orphans " + o);
+    }
+
+    auto resource_interval_l = config["resource-interval"];
+    if (resource_interval_l && resource_interval_l.IsScalar())
+        resource_interval = boost::posix_time::milliseconds(resource_interval_l.as<unsigned>());
+
+    auto latency_interval_l = config["latency-interval"];
+    if (latency_interval_l && latency_interval_l.IsScalar())
+        latency_interval = boost::posix_time::milliseconds(latency_interval_l.as<unsigned>());
+
+    auto metrics_listen_l = config["metrics-listen"];
+    if (metrics_listen_l && metrics_listen_l.IsScalar())
+        metrics_listen = metrics_listen_l.as<std::string>();
+
+    auto control_socket_l = config["control-socket"];
+    if (control_socket_l && control_socket_l.IsScalar())
+        control_socket = control_socket_l.as<std::string>();
+
+    auto log_async_l = config["log-async"];
+    if (log_async_l && log_async_l.IsScalar())
+        log_async = log_async_l.as<bool>();
+
+    auto log_batch_size_l = config["log-batch-size"];
+    if (log_batch_size_l && log_batch_size_l.IsScalar()) {
+        log_batch_size = log_batch_size_l.as<std::size_t>();
+        if (log_batch_size == 0)
+            throw config_map_exception("log-batch-size must be greater than 0");
+    }
+
+    auto log_flush_latency_l = config["log-flush-latency"];
+    if (log_flush_latency_l && log_flush_latency_l.IsScalar())
+        log_flush_latency = boost::posix_time::milliseconds(log_flush_latency_l.as<int>());
+
     for (YAML::const_iterator it = apps_k.begin(); it != apps_k.end(); it++) {
         if (!it->second.IsMap())
             throw config_map_exception(
                     "child key with name '" + it->first.as<std::string>() + "' must be a map");
         configured_application na = parse_v1_app(it->first.as<std::string>(), it->second);
-        apps.push_back(na);
+        auto &names = replica_names[na.name];
+
+        if (na.replicas == 1) {
+            names.push_back(na.name);
+            apps.push_back(na);
+            continue;
+        }
+
+        for (unsigned i = 0; i < na.replicas; i++) {
+            configured_application replica = na;
+            replica.name = na.name + "-" + std::to_string(i);
+            replica.env["CM_REPLICA_INDEX"] = std::to_string(i);
+            names.push_back(replica.name);
+            apps.push_back(replica);
+        }
+    }
+
+    std::set<std::string> names;
+    for (const auto &app : apps)
+        if (!names.insert(app.name).second)
+            throw config_map_exception("app name " + app.name + " is used twice, check the replicas");
+
+    resolve_dependencies(replica_names);
+}
+
+void cm::config_map::resolve_dependencies(const std::map<std::string, std::vector<std::string>> &replica_names) {
+
+    std::map<std::string, std::size_t> waiting;
+    std::map<std::string, std::vector<std::string>> dependents;
+
+    std::set<std::string> scheduled;
+    for (const auto &app : apps)
+        if (app.schedule)
+            scheduled.insert(app.name);
+
+    // a dependency on a replicated app waits for all of its replicas
+    for (auto &app : apps) {
+        std::vector<std::string> resolved;
+        for (const auto &dependency : app.depends_on) {
+            auto it = replica_names.find(dependency);
+            if (it == replica_names.end())
+                throw config_map_exception("app " + app.name + " depends on unknown app " + dependency);
+            resolved.insert(resolved.end(), it->second.begin(), it->second.end());
+        }
+
+        // a job is never ready, its dependents would wait forever
+        for (const auto &dependency : resolved)
+            if (scheduled.count(dependency))
+                throw config_map_exception("app " + app.name + " depends on scheduled app " + dependency);
+
+        std::sort(resolved.begin(), resolved.end());
+        resolved.erase(std::unique(resolved.begin(), resolved.end()), resolved.end());
+        app.depends_on = resolved;
+
+        waiting[app.name] = resolved.size();
+        for (const auto &dependency : resolved)
+            dependents[dependency].push_back(app.name);
+    }
+
+    // kahn's algorithm, whatever can't be ordered is part of a cycle
+    std::vector<std::string> ready;
+    for (const auto &it : waiting)
+        if (it.second == 0)
+            ready.push_back(it.first);
+
+    while (!ready.empty()) {
+        auto name = ready.back();
+        ready.pop_back();
+        waiting.erase(name);
+        for (const auto &dependent : dependents[name])
+            if (--waiting[dependent] == 0)
+                ready.push_back(dependent);
+    }
+
+    if (!waiting.empty()) {
+        std::string cycle;
+        for (const auto &it : waiting)
+            cycle += (cycle.empty() ? "" : ", ") + it.first;
+        throw config_map_exception("depends-on has a cycle between the apps " + cycle);
+    }
+}
+
+void cm::config_map::resolve_apps() {
+
+    std::vector<resolved_paths> paths;
+    paths.reserve(apps.size());
+
+    for (const auto &app : apps) {
+        trace::span resolve("resolve paths", app.name);
+        resolved_paths p;
+
+        if (boost::filesystem::exists(app.executable))
+            p.executable = app.executable;
+        else
+            p.executable = boost::process::search_path(app.executable).native();
+
+        try {
+            p.context = boost::filesystem::canonical(app.context).native();
+        } catch (const boost::filesystem::filesystem_error &e) {
+            throw config_map_exception("app " + app.name + " has invalid context: " + e.what());
+        }
+
+        if (app.ready == ready_probe::EXEC) {
+            p.probe = app.ready_target;
+            if (!boost::filesystem::exists(p.probe))
+                p.probe = boost::process::search_path(p.probe).native();
+        }
+
+        paths.push_back(std::move(p));
     }
+
+    build_spawn_blocks(paths);
+}
+
+void cm::config_map::build_spawn_blocks(const std::vector<resolved_paths> &paths) {
+
+    trace::span build("build spawn blocks");
+
+    std::map<std::string, std::string> base;
+    for (char **e = environ; *e; e++) {
+        std::string entry(*e);
+        auto eq = entry.find('=');
+        if (eq != std::string::npos)
+            base.emplace(entry.substr(0, eq), entry.substr(eq + 1));
+    }
+
+    // built once, apps without env of their own use it as is
+    std::vector<std::string> base_environment;
+    base_environment.reserve(base.size());
+    for (const auto &it : base)
+        base_environment.push_back(it.first + "=" + it.second);
+
+    auto cpus = cgroup::cpuset();
+    std::size_t next_cpu = 0;
+
+    for (std::size_t i = 0; i < apps.size(); i++) {
+        auto &app = apps[i];
+        const auto &p = paths[i];
+
+        if (app.auto_affinity)
+            app.sched.cpus = {cpus[next_cpu++ % cpus.size()]};
+
+        // both are sorted by name, the app's variables replace those of cm
+        std::vector<std::string> merged;
+        if (!app.env.empty()) {
+            merged.reserve(base.size() + app.env.size());
+            auto b = base.begin();
+            auto entry = base_environment.begin();
+            auto o = app.env.begin();
+            while (b != base.end() || o != app.env.end()) {
+                if (o == app.env.end() || (b != base.end() && b->first < o->first)) {
+                    merged.push_back(*entry);
+                } else {
+                    if (b != base.end() && b->first == o->first) {
+                        ++b, ++entry;
+                    }
+                    merged.push_back(o->first + "=" + o->second);
+                    ++o;
+                    continue;
+                }
+                ++b, ++entry;
+            }
+        }
+
+        const auto &environment = app.env.empty() ? base_environment : merged;
+
+        app.spawn = std::make_shared<const spawn_block>(p.executable, app.args, environment, p.context, app.sched);
+
+        // the probe runs in the context and environment of the app, without its scheduling
+        if (app.ready == ready_probe::EXEC)
+            app.ready_spawn = std::make_shared<const spawn_block>(p.probe, app.ready_args, environment, p.context,
+                                                                  spawn_block::scheduling{});
+    }
+}
+
+bool cm::config_map::configured_application::operator==(const configured_application &other) const {
+
+    auto same_spawn = [](const auto &a, const auto &b) {
+        return a == b || (a && b && *a == *b);
+    };
+
+    return name == other.name && executable == other.executable && context == other.context &&
+           args == other.args && term_signal == other.term_signal && stop_timeout == other.stop_timeout &&
+           env == other.env &&
+           fail_on_exit == other.fail_on_exit && fail_on_nonzero_exit == other.fail_on_nonzero_exit &&
+           mode == other.mode && max_line_length == other.max_line_length &&
+           max_buffered_bytes == other.max_buffered_bytes && truncate_long_lines == other.truncate_long_lines &&
+           log_rate == other.log_rate && log_burst == other.log_burst && restart == other.restart &&
+           restart_delay == other.restart_delay && restart_max_delay == other.restart_max_delay &&
+           restart_limit == other.restart_limit && restart_window == other.restart_window &&
+           schedule == other.schedule && overlap == other.overlap && schedule_jitter == other.schedule_jitter &&
+           replicas == other.replicas && listen == other.listen && depends_on == other.depends_on && ready == other.ready &&
+           ready_port == other.ready_port && ready_target == other.ready_target &&
+           ready_args == other.ready_args && ready_interval == other.ready_interval &&
+           ready_timeout == other.ready_timeout && auto_affinity == other.auto_affinity &&
+           sched == other.sched && same_spawn(spawn, other.spawn) && same_spawn(ready_spawn, other.ready_spawn);
 }
 
 std::shared_ptr<cm::config_map> cm::config_map::from_environment() {
@@ -125,12 +713,15 @@ std::shared_ptr<cm::config_map> cm::config_map::from_environment() {
     auto version = env["CM_VERSION"].to_string();
 
     if (version == "1") {
+        trace::span parse("parse environment");
         auto node = env_to_yaml_v1(env);
         map->parse_v1(node);
     } else {
         throw config_map_exception("unknown version");
     }
 
+    map->resolve_apps();
+
     return map;
 
 }
@@ -161,6 +752,28 @@ YAML::Node cm::config_map::env_to_yaml_v1(const boost::process::environment &env
                 root["version"] = entry.to_string();
             else if (is_equal(split.begin(), split.end(), {prefix, "KILL-DELAY"}))
                 root["kill-delay"] = entry.to_string();
+            else if (is_equal(split.begin(), split.end(), {prefix, "THREADS"}))
+                root["threads"] = entry.to_string();
+            else if (is_equal(split.begin(), split.end(), {prefix, "SPAWN-THREADS"}))
+                root["spawn-threads"] = entry.to_string();
+            else if (is_equal(split.begin(), split.end(), {prefix, "IO-ENGINE"}))
+                root["io-engine"] = entry.to_string();
+            else if (is_equal(split.begin(), split.end(), {prefix, "REAP-ORPHANS"}))
+                root["reap-orphans"] = entry.to_string();
+            else if (is_equal(split.begin(), split.end(), {prefix, "RESOURCE-INTERVAL"}))
+                root["resource-interval"] = entry.to_string();
+            else if (is_equal(split.begin(), split.end(), {prefix, "LATENCY-INTERVAL"}))
+                root["latency-interval"] = entry.to_string();
+            else if (is_equal(split.begin(), split.end(), {prefix, "METRICS-LISTEN"}))
+                root["metrics-listen"] = entry.to_string();
+            else if (is_equal(split.begin(), split.end(), {prefix, "CONTROL-SOCKET"}))
+                root["control-socket"] = entry.to_string();
+            else if (is_equal(split.begin(), split.end(), {prefix, "LOG-ASYNC"}))
+                root["log-async"] = entry.to_string();
+            else if (is_equal(split.begin(), split.end(), {prefix, "LOG-BATCH-SIZE"}))
+                root["log-batch-size"] = entry.to_string();
+            else if (is_equal(split.begin(), split.end(), {prefix, "LOG-FLUSH-LATENCY"}))
+                root["log-flush-latency"] = entry.to_string();
             else if (is_equal(split.begin(), split.begin() + 2, {prefix, "APPS"})) {
                 const std::string name = boost::to_lower_copy(split.at(2));
                 if (!root["apps"][name].IsMap())
@@ -175,6 +788,64 @@ YAML::Node cm::config_map::env_to_yaml_v1(const boost::process::environment &env
                     root["apps"][name]["fail-on-exit"] = entry.to_string();
                 else if (option == "TERM-SIGNAL")
                     root["apps"][name]["term-signal"] = entry.to_string();
+                else if (option == "LOG-MODE")
+                    root["apps"][name]["log-mode"] = entry.to_string();
+                else if (option == "MAX-LINE-LENGTH")
+                    root["apps"][name]["max-line-length"] = entry.to_string();
+                else if (option == "MAX-BUFFERED-BYTES")
+                    root["apps"][name]["max-buffered-bytes"] = entry.to_string();
+                else if (option == "LONG-LINES")
+                    root["apps"][name]["long-lines"] = entry.to_string();
+                else if (option == "LOG-RATE")
+                    root["apps"][name]["log-rate"] = entry.to_string();
+                else if (option == "LOG-BURST")
+                    root["apps"][name]["log-burst"] = entry.to_string();
+                else if (option == "STOP-TIMEOUT")
+                    root["apps"][name]["stop-timeout"] = entry.to_string();
+                else if (option == "SCHEDULE")
+                    root["apps"][name]["schedule"] = entry.to_string();
+                else if (option == "SCHEDULE-OVERLAP")
+                    root["apps"][name]["schedule-overlap"] = entry.to_string();
+                else if (option == "SCHEDULE-JITTER")
+                    root["apps"][name]["schedule-jitter"] = entry.to_string();
+                else if (option == "RESTART")
+                    root["apps"][name]["restart"] = entry.to_string();
+                else if (option == "RESTART-DELAY")
+                    root["apps"][name]["restart-delay"] = entry.to_string();
+                else if (option == "RESTART-MAX-DELAY")
+                    root["apps"][name]["restart-max-delay"] = entry.to_string();
+                else if (option == "RESTART-LIMIT")
+                    root["apps"][name]["restart-limit"] = entry.to_string();
+                else if (option == "RESTART-WINDOW")
+                    root["apps"][name]["restart-window"] = entry.to_string();
+                else if (option == "LISTEN")
+                    root["apps"][name]["listen"] = entry.to_string();
+                else if (option == "DEPENDS-ON")
+                    root["apps"][name]["depends-on"] = entry.to_string();
+                else if (option == "READY-PORT")
+                    root["apps"][name]["ready-when"]["port"] = entry.to_string();
+                else if (option == "READY-FILE")
+                    root["apps"][name]["ready-when"]["file"] = entry.to_string();
+                else if (option == "READY-EXEC")
+                    root["apps"][name]["ready-when"]["exec"] = entry.to_string();
+                else if (option == "READY-LOG")
+                    root["apps"][name]["ready-when"]["log"] = entry.to_string();
+                else if (option == "READY-INTERVAL")
+                    root["apps"][name]["ready-interval"] = entry.to_string();
+                else if (option == "READY-TIMEOUT")
+                    root["apps"][name]["ready-timeout"] = entry.to_string();
+                else if (option == "REPLICAS")
+                    root["apps"][name]["replicas"] = entry.to_string();
+                else if (option == "CPU-AFFINITY")
+                    root["apps"][name]["cpu-affinity"] = entry.to_string();
+                else if (option == "NICE")
+                    root["apps"][name]["nice"] = entry.to_string();
+                else if (option == "SCHED-POLICY")
+                    root["apps"][name]["sched-policy"] = entry.to_string();
+                else if (option == "SCHED-PRIORITY")
+                    root["apps"][name]["sched-priority"] = entry.to_string();
+                else if (option == "IO-PRIORITY")
+                    root["apps"][name]["io-priority"] = entry.to_string();
                 else
                     throw config_map_exception("Unknown app option: " + key);
             } else {
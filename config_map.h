@@ -1,6 +1,7 @@
 #ifndef CM_CONFIG_MAP_H
 #define CM_CONFIG_MAP_H
 
+#include <optional>
 #include <vector>
 #include <string>
 #include <csignal>
@@ -9,6 +10,8 @@
 #include <boost/process.hpp>
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/tokenizer.hpp>
+#include "cron_schedule.h"
+#include "spawn_block.h"
 
 namespace cm {
 
@@ -25,30 +28,161 @@ namespace cm {
     class config_map {
     public:
 
+        enum class log_mode {
+            LINE, RAW
+        };
+
+        enum class restart_mode {
+            NEVER, ON_FAILURE, ALWAYS
+        };
+
+        enum class ready_probe {
+            NONE, PORT, FILE, EXEC, LOG
+        };
+
+        enum class overlap_policy {
+            SKIP, QUEUE, KILL
+        };
+
+        enum class io_engine {
+            EPOLL, IO_URING
+        };
+
+        enum class orphan_mode {
+            AUTO, SUBREAPER, OFF
+        };
+
         struct configured_application {
             std::string name, executable, context;
             std::vector<std::string> args;
             int term_signal;
+            // time from term_signal to SIGKILL when the app is stopped. 0: kill_delay
+            boost::posix_time::milliseconds stop_timeout{0};
             std::map<std::string, std::string> env;
             bool fail_on_exit = true;
             bool fail_on_nonzero_exit = true;
+            log_mode mode = log_mode::LINE;
+            std::size_t max_line_length = 1024 * 1024;
+            std::size_t max_buffered_bytes = 2 * 1024 * 1024;
+            bool truncate_long_lines = false;
+            double log_rate = 0;
+            double log_burst = 0;
+            restart_mode restart = restart_mode::NEVER;
+            boost::posix_time::milliseconds restart_delay{100};
+            boost::posix_time::milliseconds restart_max_delay{30000};
+            // restarts allowed within restart_window before the app counts as crash looping. 0: unlimited
+            unsigned restart_limit = 5;
+            boost::posix_time::milliseconds restart_window{60000};
+            // run as a job whenever the schedule is due instead of supervising a long running process
+            std::optional<cron_schedule> schedule;
+            overlap_policy overlap = overlap_policy::SKIP;
+            // random delay of up to schedule_jitter added to every run
+            boost::posix_time::milliseconds schedule_jitter{0};
+            unsigned replicas = 1;
+            // sockets bound by cm and passed to every start as fd 3 and up, see listen_socket
+            std::vector<std::string> listen;
+            // names of the apps which have to be ready before this one starts
+            std::vector<std::string> depends_on;
+            ready_probe ready = ready_probe::NONE;
+            unsigned short ready_port = 0;
+            // file path, log line pattern or probe executable
+            std::string ready_target;
+            std::vector<std::string> ready_args;
+            boost::posix_time::milliseconds ready_interval{100};
+            // 0: wait forever
+            boost::posix_time::milliseconds ready_timeout{0};
+            // pin to one cpu of cm's cpuset, round-robin over all apps with cpu-affinity auto
+            bool auto_affinity = false;
+            spawn_block::scheduling sched;
+            // resolved executable, argv and environment, see resolve_apps
+            std::shared_ptr<const spawn_block> spawn, ready_spawn;
+
+            /**
+             * Compares the settings and the resolved spawn blocks, a reload restarts an app when they differ.
+             */
+            bool operator==(const configured_application &other) const;
+
+            bool operator!=(const configured_application &other) const {
+                return !(*this == other);
+            }
         };
 
         std::vector<configured_application> apps;
         boost::posix_time::milliseconds kill_delay;
 
+        // threads running the event loop. 0: cpu quota of the container
+        unsigned threads = 0;
+        io_engine engine = io_engine::EPOLL;
+        // reap processes left behind by the apps. AUTO: when cm runs as PID 1
+        orphan_mode orphans = orphan_mode::AUTO;
+        // threads starting the apps, the first app is always started alone
+        unsigned spawn_threads = 1;
+
+        // sample cpu, memory and io of the apps every resource_interval. 0: off
+        boost::posix_time::milliseconds resource_interval{0};
+
+        // log percentiles of the time from reading a line to writing it every latency_interval. 0: off
+        boost::posix_time::milliseconds latency_interval{0};
+
+        // host:port or unix socket path to serve metrics on. empty: off
+        std::string metrics_listen;
+
+        // unix socket path for cm ctl. empty: off
+        std::string control_socket;
+
+        bool log_async = false;
+        std::size_t log_batch_size = 64;
+        boost::posix_time::milliseconds log_flush_latency{0};
+
         static std::shared_ptr<config_map> from_file(const std::string &file);
         static std::shared_ptr<config_map> from_environment();
 
+        /**
+         * Loads the configuration again from the file or the environment it was loaded from.
+         */
+        [[nodiscard]] std::shared_ptr<config_map> reload() const;
+
+        /**
+         * Writes a validated binary image of the configuration with tokenized arguments and resolved
+         * paths. from_file recognizes it and loads it without parsing yaml or searching PATH.
+         */
+        void write_snapshot(const std::string &file) const;
+
         explicit config_map(int kill_delay);
 
     private:
 
+        // file the configuration was loaded from, empty for the environment
+        std::string source;
+
+        /**
+         * Returns nullptr if file isn't a snapshot.
+         */
+        static std::shared_ptr<config_map> load_snapshot(const std::string &file);
+
         static configured_application parse_v1_app(const std::string &name, const YAML::Node &node);
 
         static YAML::Node env_to_yaml_v1(const boost::process::environment &env);
 
         void parse_v1(const YAML::Node &config);
+
+        void resolve_dependencies(const std::map<std::string, std::vector<std::string>> &replica_names);
+
+        // executable, context and probe of an app as found when the configuration was loaded
+        struct resolved_paths {
+            std::string executable, context, probe;
+        };
+
+        /**
+         * Validates contexts and searches executables in PATH, then builds the spawn blocks.
+         */
+        void resolve_apps();
+
+        /**
+         * Merges each app's env into cm's environment and builds the spawn blocks. Cpus of
+         * cpu-affinity auto are assigned here, they depend on the cpuset cm runs in.
+         */
+        void build_spawn_blocks(const std::vector<resolved_paths> &paths);
     };
 }
 
@@ -0,0 +1,393 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "config_map.h"
+#include "constants.h"
+#include "trace.h"
+
+/*
+ * Layout of a snapshot, all numbers in the byte order of the machine which compiled it:
+ *
+ *   magic "CMSNAP\0\0", format (u32), size of the payload (u64), fnv-1a hash of the payload (u64)
+ *   payload: version of cm, global settings, number of apps, each app with its resolved paths
+ *
+ * Strings are a u64 length followed by the bytes, lists a u64 count followed by the elements.
+ * The image is only valid for the cm version which wrote it, any other version rejects it.
+ */
+
+namespace {
+
+    const char magic[8] = {'C', 'M', 'S', 'N', 'A', 'P', 0, 0};
+    const std::uint32_t format = 6;
+    const std::size_t header_size = sizeof(magic) + sizeof(std::uint32_t) + 2 * sizeof(std::uint64_t);
+
+    std::uint64_t fnv1a(const char *data, std::size_t size) {
+        std::uint64_t hash = 14695981039346656037ULL;
+        for (std::size_t i = 0; i < size; i++) {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    class writer {
+
+    public:
+        template<typename T>
+        void put(T value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+        }
+
+        void put(const std::string &value) {
+            put<std::uint64_t>(value.size());
+            out.append(value);
+        }
+
+        void put(const std::vector<std::string> &values) {
+            put<std::uint64_t>(values.size());
+            for (const auto &v : values)
+                put(v);
+        }
+
+        void put(const boost::posix_time::milliseconds &value) {
+            put<std::int64_t>(value.total_milliseconds());
+        }
+
+        void put(const std::optional<int> &value) {
+            put<std::uint8_t>(value.has_value());
+            put<std::int32_t>(value.value_or(0));
+        }
+
+        std::string out;
+    };
+
+    class reader {
+
+    public:
+        reader(const char *begin, const char *end) : p(begin), end(end) {
+        }
+
+        template<typename T>
+        T get() {
+            T value;
+            std::memcpy(&value, take(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        std::string get_string() {
+            auto size = get<std::uint64_t>();
+            const char *data = take(size);
+            return std::string(data, size);
+        }
+
+        std::vector<std::string> get_strings() {
+            auto count = get<std::uint64_t>();
+            std::vector<std::string> values;
+            values.reserve(std::min<std::uint64_t>(count, remaining()));
+            for (std::uint64_t i = 0; i < count; i++)
+                values.push_back(get_string());
+            return values;
+        }
+
+        boost::posix_time::milliseconds get_duration() {
+            return boost::posix_time::milliseconds(get<std::int64_t>());
+        }
+
+        std::optional<int> get_optional() {
+            bool set = get<std::uint8_t>();
+            int value = get<std::int32_t>();
+            return set ? std::optional<int>(value) : std::nullopt;
+        }
+
+        [[nodiscard]] std::size_t remaining() const {
+            return end - p;
+        }
+
+    private:
+        const char *take(std::uint64_t size) {
+            if (size > remaining())
+                throw cm::config_map_exception("snapshot is truncated");
+            const char *data = p;
+            p += size;
+            return data;
+        }
+
+        const char *p, *end;
+    };
+
+    class mapped_file {
+
+    public:
+        explicit mapped_file(const std::string &file) {
+            fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd == -1)
+                return;
+
+            struct stat st{};
+            if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+                void *m = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (m != MAP_FAILED) {
+                    data = static_cast<const char *>(m);
+                    size = st.st_size;
+                }
+            }
+        }
+
+        mapped_file(const mapped_file &) = delete;
+
+        ~mapped_file() {
+            if (data)
+                ::munmap(const_cast<char *>(data), size);
+            if (fd != -1)
+                ::close(fd);
+        }
+
+        const char *data = nullptr;
+        std::size_t size = 0;
+
+    private:
+        int fd = -1;
+    };
+}
+
+void cm::config_map::write_snapshot(const std::string &file) const {
+
+    writer w;
+    w.put(app_version);
+
+    w.put(kill_delay);
+    w.put<std::uint32_t>(threads);
+    w.put(engine);
+    w.put(orphans);
+    w.put<std::uint32_t>(spawn_threads);
+    w.put(resource_interval);
+    w.put(latency_interval);
+    w.put(metrics_listen);
+    w.put(control_socket);
+    w.put<std::uint8_t>(log_async);
+    w.put<std::uint64_t>(log_batch_size);
+    w.put(log_flush_latency);
+
+    w.put<std::uint64_t>(apps.size());
+    for (const auto &app : apps) {
+        w.put(app.name);
+        w.put(app.executable);
+        w.put(app.context);
+        w.put(app.args);
+        w.put<std::int32_t>(app.term_signal);
+        w.put(app.stop_timeout);
+
+        w.put<std::uint64_t>(app.env.size());
+        for (const auto &it : app.env) {
+            w.put(it.first);
+            w.put(it.second);
+        }
+
+        w.put<std::uint8_t>(app.fail_on_exit);
+        w.put<std::uint8_t>(app.fail_on_nonzero_exit);
+        w.put(app.mode);
+        w.put<std::uint64_t>(app.max_line_length);
+        w.put<std::uint64_t>(app.max_buffered_bytes);
+        w.put<std::uint8_t>(app.truncate_long_lines);
+        w.put(app.log_rate);
+        w.put(app.log_burst);
+        w.put(app.restart);
+        w.put(app.restart_delay);
+        w.put(app.restart_max_delay);
+        w.put<std::uint32_t>(app.restart_limit);
+        w.put(app.restart_window);
+        w.put(app.schedule ? app.schedule->expression() : std::string());
+        w.put(app.overlap);
+        w.put(app.schedule_jitter);
+        w.put<std::uint32_t>(app.replicas);
+        w.put(app.listen);
+        w.put(app.depends_on);
+        w.put(app.ready);
+        w.put(app.ready_port);
+        w.put(app.ready_target);
+        w.put(app.ready_args);
+        w.put(app.ready_interval);
+        w.put(app.ready_timeout);
+        w.put<std::uint8_t>(app.auto_affinity);
+
+        w.put<std::uint64_t>(app.sched.cpus.size());
+        for (int cpu : app.sched.cpus)
+            w.put<std::int32_t>(cpu);
+        w.put(app.sched.nice);
+        w.put(app.sched.policy);
+        w.put<std::int32_t>(app.sched.priority);
+        w.put(app.sched.io_class);
+        w.put<std::int32_t>(app.sched.io_level);
+
+        // what resolve_apps found, loading the snapshot doesn't touch the filesystem
+        w.put(app.spawn->executable());
+        w.put(app.spawn->directory());
+        w.put(app.ready_spawn ? app.ready_spawn->executable() : std::string());
+    }
+
+    writer header;
+    header.out.append(magic, sizeof(magic));
+    header.put(format);
+    header.put<std::uint64_t>(w.out.size());
+    header.put(fnv1a(w.out.data(), w.out.size()));
+
+    // replaced atomically, a running cm may reload it at any time
+    std::string temp = file + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+        throw config_map_exception("can't write " + temp + ": " + std::strerror(errno));
+
+    // a write making no progress leaves errno untouched, it counts as EIO
+    int error = 0;
+    for (const auto *part : {&header.out, &w.out}) {
+        const char *p = part->data();
+        std::size_t left = part->size();
+        while (error == 0 && left > 0) {
+            ssize_t n = ::write(fd, p, left);
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                error = n == 0 ? EIO : errno;
+                break;
+            }
+            p += n;
+            left -= n;
+        }
+    }
+
+    // on disk before it replaces the old snapshot, a crash leaves one of them complete
+    if (error == 0 && ::fsync(fd) == -1)
+        error = errno;
+    if (::close(fd) == -1 && error == 0)
+        error = errno;
+    if (error == 0 && ::rename(temp.c_str(), file.c_str()) == -1)
+        error = errno;
+
+    if (error != 0) {
+        ::unlink(temp.c_str());
+        throw config_map_exception("can't write " + file + ": " + std::strerror(error));
+    }
+}
+
+std::shared_ptr<cm::config_map> cm::config_map::load_snapshot(const std::string &file) {
+
+    auto begin = trace::clock::now();
+    mapped_file mapped(file);
+
+    if (mapped.size < sizeof(magic) || std::memcmp(mapped.data, magic, sizeof(magic)) != 0)
+        return nullptr;
+
+    reader header(mapped.data + sizeof(magic), mapped.data + mapped.size);
+    if (mapped.size < header_size || header.get<std::uint32_t>() != format)
+        throw config_map_exception("unknown snapshot format in " + file);
+
+    auto size = header.get<std::uint64_t>();
+    auto checksum = header.get<std::uint64_t>();
+    const char *payload = mapped.data + header_size;
+
+    if (size != mapped.size - header_size || fnv1a(payload, size) != checksum)
+        throw config_map_exception("snapshot " + file + " is corrupt");
+
+    reader r(payload, payload + size);
+
+    auto version = r.get_string();
+    if (version != app_version)
+        throw config_map_exception("snapshot " + file + " was compiled by " + app_name + " " + version +
+                                   ", compile it again with " + app_version);
+
+    auto map = std::make_shared<config_map>(0);
+    map->source = file;
+
+    map->kill_delay = r.get_duration();
+    map->threads = r.get<std::uint32_t>();
+    map->engine = r.get<io_engine>();
+    map->orphans = r.get<orphan_mode>();
+    map->spawn_threads = r.get<std::uint32_t>();
+    map->resource_interval = r.get_duration();
+    map->latency_interval = r.get_duration();
+    map->metrics_listen = r.get_string();
+    map->control_socket = r.get_string();
+    map->log_async = r.get<std::uint8_t>();
+    map->log_batch_size = r.get<std::uint64_t>();
+    map->log_flush_latency = r.get_duration();
+
+    auto count = r.get<std::uint64_t>();
+    std::vector<resolved_paths> paths;
+    map->apps.reserve(std::min<std::uint64_t>(count, r.remaining()));
+
+    for (std::uint64_t i = 0; i < count; i++) {
+        configured_application app;
+
+        app.name = r.get_string();
+        app.executable = r.get_string();
+        app.context = r.get_string();
+        app.args = r.get_strings();
+        app.term_signal = r.get<std::int32_t>();
+        app.stop_timeout = r.get_duration();
+
+        auto env = r.get<std::uint64_t>();
+        for (std::uint64_t e = 0; e < env; e++) {
+            auto key = r.get_string();
+            app.env[key] = r.get_string();
+        }
+
+        app.fail_on_exit = r.get<std::uint8_t>();
+        app.fail_on_nonzero_exit = r.get<std::uint8_t>();
+        app.mode = r.get<log_mode>();
+        app.max_line_length = r.get<std::uint64_t>();
+        app.max_buffered_bytes = r.get<std::uint64_t>();
+        app.truncate_long_lines = r.get<std::uint8_t>();
+        app.log_rate = r.get<double>();
+        app.log_burst = r.get<double>();
+        app.restart = r.get<restart_mode>();
+        app.restart_delay = r.get_duration();
+        app.restart_max_delay = r.get_duration();
+        app.restart_limit = r.get<std::uint32_t>();
+        app.restart_window = r.get_duration();
+        // validated when the snapshot was compiled
+        auto schedule = r.get_string();
+        if (!schedule.empty())
+            app.schedule = cron_schedule(schedule);
+        app.overlap = r.get<overlap_policy>();
+        app.schedule_jitter = r.get_duration();
+        app.replicas = r.get<std::uint32_t>();
+        app.listen = r.get_strings();
+        app.depends_on = r.get_strings();
+        app.ready = r.get<ready_probe>();
+        app.ready_port = r.get<unsigned short>();
+        app.ready_target = r.get_string();
+        app.ready_args = r.get_strings();
+        app.ready_interval = r.get_duration();
+        app.ready_timeout = r.get_duration();
+        app.auto_affinity = r.get<std::uint8_t>();
+
+        auto cpus = r.get<std::uint64_t>();
+        for (std::uint64_t c = 0; c < cpus; c++)
+            app.sched.cpus.push_back(r.get<std::int32_t>());
+        app.sched.nice = r.get_optional();
+        app.sched.policy = r.get_optional();
+        app.sched.priority = r.get<std::int32_t>();
+        app.sched.io_class = r.get_optional();
+        app.sched.io_level = r.get<std::int32_t>();
+
+        resolved_paths p;
+        p.executable = r.get_string();
+        p.context = r.get_string();
+        p.probe = r.get_string();
+        paths.push_back(std::move(p));
+
+        map->apps.push_back(std::move(app));
+    }
+
+    if (r.remaining() != 0)
+        throw config_map_exception("snapshot " + file + " is corrupt");
+
+    map->build_spawn_blocks(paths);
+
+    trace::complete("load snapshot", file, begin, trace::clock::now());
+    return map;
+}
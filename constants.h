@@ -47,6 +47,13 @@ namespace cm {
 #endif
     };
 
+    // signals cm ctl may send besides the ones above, they make no sense as term-signal
+    const std::vector<std::pair<int, std::string>> control_signals = {
+            {SIGKILL,   "SIGKILL"},
+            {SIGSTOP,   "SIGSTOP"},
+            {SIGCHLD,   "SIGCHLD"},
+    };
+
     inline int signal_string_to_int(const std::string &signal_str) {
         auto upper = boost::to_upper_copy(signal_str);
 
@@ -59,6 +66,19 @@ namespace cm {
         else
             return (*it).first;
     }
+
+    /**
+     * Like signal_string_to_int, also accepting the control_signals.
+     */
+    inline int control_signal_to_int(const std::string &signal_str) {
+        auto upper = boost::to_upper_copy(signal_str);
+
+        auto it = find_if(control_signals.begin(), control_signals.end(), [&](const auto &signal) {
+            return upper == std::to_string(signal.first) || upper == signal.second;
+        });
+
+        return it == control_signals.end() ? signal_string_to_int(signal_str) : (*it).first;
+    }
 }
 
 #endif //CM_CONSTANTS_H
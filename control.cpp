@@ -0,0 +1,251 @@
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "control.h"
+
+namespace asio = boost::asio;
+using local = asio::local::stream_protocol;
+
+namespace {
+
+    const std::chrono::seconds request_timeout(5);
+    const std::size_t max_request = 4096;
+    // text queued for a client which doesn't read, beyond that it's dropped
+    const std::size_t max_queued = 1 << 20;
+
+    class session : public cm::control_session, public std::enable_shared_from_this<session> {
+
+    public:
+        session(local::socket socket, const cm::control_server::handler_type &handler)
+                : socket(std::move(socket)), strand(this->socket.get_executor()),
+                  timer(this->socket.get_executor()), request(max_request), handler(handler) {
+        }
+
+        void start() {
+            auto self = shared_from_this();
+
+            timer.expires_after(request_timeout);
+            timer.async_wait(asio::bind_executor(strand, [self](const boost::system::error_code &ec) {
+                if (!ec)
+                    self->finish();
+            }));
+
+            asio::async_read_until(socket, request, '\n', asio::bind_executor(
+                    strand, [self](const boost::system::error_code &ec, std::size_t) {
+                        self->timer.cancel();
+                        if (ec) {
+                            self->finish();
+                            return;
+                        }
+
+                        std::istream is(&self->request);
+                        std::string line, word;
+                        std::getline(is, line);
+                        std::istringstream words(line);
+                        std::vector<std::string> parsed;
+                        while (words >> word)
+                            parsed.push_back(word);
+
+                        self->watch();
+                        self->handler(std::move(parsed), self);
+                    }));
+        }
+
+        bool send(std::string_view text) override {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (gone)
+                return false;
+
+            if (pending.size() + text.size() > max_queued) {
+                dropped++;
+                return true;
+            }
+
+            if (dropped > 0) {
+                pending.append("[" + std::to_string(dropped) + " lines dropped]\n");
+                dropped = 0;
+            }
+
+            pending.append(text);
+            if (!writing) {
+                writing = true;
+                asio::post(strand, [self = shared_from_this()]() { self->write(); });
+            }
+            return true;
+        }
+
+        void close() override {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+            if (!writing)
+                asio::post(strand, [self = shared_from_this()]() { self->finish(); });
+        }
+
+    private:
+        // everything queued goes out with one write, a tail of a chatty app doesn't cost a write per line
+        void write() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (pending.empty()) {
+                    writing = false;
+                    if (closing)
+                        asio::post(strand, [self = shared_from_this()]() { self->finish(); });
+                    return;
+                }
+                outgoing.clear();
+                outgoing.swap(pending);
+            }
+
+            auto self = shared_from_this();
+            asio::async_write(socket, asio::buffer(outgoing), asio::bind_executor(
+                    strand, [self](const boost::system::error_code &ec, std::size_t) {
+                        if (ec)
+                            self->finish();
+                        else
+                            self->write();
+                    }));
+        }
+
+        // the client doesn't send anything after the request, a completed read means it hung up
+        void watch() {
+            auto self = shared_from_this();
+            socket.async_read_some(asio::buffer(ignored), asio::bind_executor(
+                    strand, [self](const boost::system::error_code &ec, std::size_t) {
+                        if (ec)
+                            self->finish();
+                        else
+                            self->watch();
+                    }));
+        }
+
+        void finish() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                gone = true;
+                writing = false;
+                pending.clear();
+            }
+
+            boost::system::error_code ignored_ec;
+            timer.cancel();
+            socket.shutdown(local::socket::shutdown_both, ignored_ec);
+            socket.close(ignored_ec);
+        }
+
+        local::socket socket;
+        asio::strand<local::socket::executor_type> strand;
+        asio::steady_timer timer;
+        asio::streambuf request;
+        std::array<char, 256> ignored{};
+        const cm::control_server::handler_type &handler;
+
+        std::mutex mutex;
+        std::string pending, outgoing;
+        std::size_t dropped = 0;
+        bool writing = false, closing = false, gone = false;
+    };
+}
+
+cm::control_server::control_server(asio::io_service &ios, const std::string &path, handler_type handler)
+        : strand(ios), acceptor(ios), path(path), handler(std::move(handler)) {
+
+    // bind with owner only permissions, the socket allows to stop and signal every app
+    mode_t mask = ::umask(0077);
+    try {
+        acceptor.open();
+        acceptor.bind(local::endpoint(path));
+        acceptor.listen();
+        this->path.bound();
+    } catch (...) {
+        ::umask(mask);
+        throw;
+    }
+    ::umask(mask);
+
+    accept();
+}
+
+void cm::control_server::stop() {
+    asio::post(strand, [this]() {
+        boost::system::error_code ignored;
+        acceptor.close(ignored);
+        for (auto &s : sessions)
+            if (auto open = s.lock())
+                open->close();
+        sessions.clear();
+    });
+}
+
+void cm::control_server::accept() {
+    acceptor.async_accept(asio::bind_executor(strand, [this](const boost::system::error_code &ec,
+                                                             local::socket socket) {
+        if (ec == asio::error::operation_aborted)
+            return;
+
+        if (!ec) {
+            auto s = std::make_shared<session>(std::move(socket), handler);
+
+            sessions.erase(std::remove_if(sessions.begin(), sessions.end(), [](auto &w) { return w.expired(); }),
+                           sessions.end());
+            sessions.push_back(s);
+            s->start();
+        }
+        accept();
+    }));
+}
+
+int cm::control_request(const std::string &path, const std::vector<std::string> &request,
+                        std::ostream &out, std::ostream &err) {
+
+    asio::io_service ios;
+    local::socket socket(ios);
+    socket.connect(local::endpoint(path));
+
+    std::string line;
+    for (const auto &word : request) {
+        if (!line.empty())
+            line.push_back(' ');
+        line.append(word);
+    }
+    line.push_back('\n');
+    asio::write(socket, asio::buffer(line));
+
+    // the status line decides where the rest goes, output is passed on as it arrives for tail
+    std::string status;
+    bool ok = false, decided = false;
+    std::array<char, 8192> buf{};
+
+    for (;;) {
+        boost::system::error_code ec;
+        std::size_t n = socket.read_some(asio::buffer(buf), ec);
+        if (ec)
+            break;
+
+        std::string_view data(buf.data(), n);
+
+        if (!decided) {
+            auto newline = data.find('\n');
+            status.append(data.substr(0, newline));
+            if (newline == std::string_view::npos)
+                continue;
+
+            decided = true;
+            ok = status == "ok";
+            data.remove_prefix(newline + 1);
+
+            if (!ok)
+                err << (status.rfind("error: ", 0) == 0 ? status.substr(7) : status) << "\n";
+        }
+
+        (ok ? out : err).write(data.data(), static_cast<std::streamsize>(data.size()));
+        (ok ? out : err).flush();
+    }
+
+    if (!decided)
+        err << "no reply from " << path << "\n";
+
+    return ok ? 0 : 1;
+}
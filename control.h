@@ -0,0 +1,76 @@
+#ifndef CM_CONTROL_H
+#define CM_CONTROL_H
+
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include "socket_path.h"
+
+namespace cm {
+
+    /**
+     * Connection of a control client. A request is one line of words, the reply starts with a line
+     * "ok" or "error: <message>" followed by the output of the command. The connection is closed
+     * after the reply, except for commands which stream output like tail.
+     */
+    class control_session {
+
+    public:
+        virtual ~control_session() = default;
+
+        /**
+         * Queues text for the client, can be called from any thread. Returns false once the client
+         * is gone. A client which doesn't keep up loses text instead of making the queue grow.
+         */
+        virtual bool send(std::string_view text) = 0;
+
+        /**
+         * Closes the connection once everything queued was written.
+         */
+        virtual void close() = 0;
+    };
+
+    /**
+     * Accepts control clients on a unix socket, readable and writable for the owner only.
+     */
+    class control_server {
+
+    public:
+        typedef std::function<void(std::vector<std::string>, std::shared_ptr<control_session>)> handler_type;
+
+        control_server(const control_server &) = delete;
+
+        /**
+         * Throws boost::system::system_error if path can't be bound, std::system_error if it is taken
+         * by something else.
+         */
+        control_server(boost::asio::io_service &ios, const std::string &path, handler_type handler);
+
+        /**
+         * Stops accepting and closes all connections, streaming ones included.
+         */
+        void stop();
+
+    private:
+        void accept();
+
+        boost::asio::io_service::strand strand;
+        boost::asio::local::stream_protocol::acceptor acceptor;
+        socket_path path;
+        handler_type handler;
+        std::vector<std::weak_ptr<control_session>> sessions;
+    };
+
+    /**
+     * Client side of cm ctl. Sends the request and copies the reply to out, errors go to err.
+     * Returns 0 if the command succeeded, 1 otherwise. Throws boost::system::system_error if the
+     * socket can't be reached.
+     */
+    int control_request(const std::string &path, const std::vector<std::string> &request,
+                        std::ostream &out, std::ostream &err);
+}
+
+#endif //CM_CONTROL_H
@@ -0,0 +1,159 @@
+#include <ctime>
+#include <stdexcept>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+#include "cron_schedule.h"
+
+namespace {
+
+    struct field {
+        const char *name;
+        int min, max;
+        std::vector<std::string> names;
+    };
+
+    const field minute_field{"minute", 0, 59, {}};
+    const field hour_field{"hour", 0, 23, {}};
+    const field day_field{"day of month", 1, 31, {}};
+    const field month_field{"month", 1, 12,
+                            {"jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec"}};
+    // 7 is sunday as well
+    const field weekday_field{"day of week", 0, 7, {"sun", "mon", "tue", "wed", "thu", "fri", "sat"}};
+
+    int parse_value(const field &f, const std::string &value) {
+        for (std::size_t i = 0; i < f.names.size(); i++)
+            if (value == f.names[i])
+                return f.min + static_cast<int>(i);
+
+        std::size_t end = 0;
+        int v = -1;
+        try {
+            v = std::stoi(value, &end);
+        } catch (const std::logic_error &) {
+        }
+        if (value.empty() || end != value.size() || v < f.min || v > f.max)
+            throw std::invalid_argument(std::string("invalid ") + f.name + " " + value);
+        return v;
+    }
+
+    // sets the bits of all values in a list like "1-5,10-30/5,*/15"
+    template<std::size_t N>
+    void parse_field(const field &f, const std::string &text, std::bitset<N> &bits) {
+        std::vector<std::string> items;
+        boost::split(items, boost::to_lower_copy(text), boost::is_any_of(","));
+
+        for (const auto &item : items) {
+            auto slash = item.find('/');
+            auto range = item.substr(0, slash);
+            int step = 1;
+            if (slash != std::string::npos) {
+                try {
+                    step = std::stoi(item.substr(slash + 1));
+                } catch (const std::logic_error &) {
+                    step = 0;
+                }
+                if (step <= 0)
+                    throw std::invalid_argument(std::string("invalid step in ") + f.name + " " + item);
+            }
+
+            int first = f.min, last = f.max;
+            if (range != "*") {
+                auto dash = range.find('-');
+                first = parse_value(f, range.substr(0, dash));
+                // "5/15" runs from 5 to the end like "5-59/15"
+                last = dash != std::string::npos ? parse_value(f, range.substr(dash + 1))
+                                                 : slash != std::string::npos ? f.max : first;
+                if (last < first)
+                    throw std::invalid_argument(std::string("invalid range in ") + f.name + " " + item);
+            }
+
+            for (int v = first; v <= last; v += step)
+                bits.set(static_cast<std::size_t>(v % static_cast<int>(N)));
+        }
+    }
+}
+
+cm::cron_schedule::cron_schedule(const std::string &expression)
+        : source(expression) {
+
+    auto text = boost::trim_copy(boost::to_lower_copy(expression));
+
+    if (text == "@yearly" || text == "@annually")
+        text = "0 0 1 1 *";
+    else if (text == "@monthly")
+        text = "0 0 1 * *";
+    else if (text == "@weekly")
+        text = "0 0 * * 0";
+    else if (text == "@daily" || text == "@midnight")
+        text = "0 0 * * *";
+    else if (text == "@hourly")
+        text = "0 * * * *";
+
+    std::vector<std::string> fields;
+    boost::split(fields, text, boost::is_any_of(" \t"), boost::token_compress_on);
+    if (fields.size() != 5)
+        throw std::invalid_argument("needs minute, hour, day of month, month and day of week");
+
+    parse_field(minute_field, fields[0], minutes);
+    parse_field(hour_field, fields[1], hours);
+    parse_field(day_field, fields[2], days);
+    parse_field(month_field, fields[3], months);
+    // weekday 7 wraps to 0
+    parse_field(weekday_field, fields[4], weekdays);
+
+    any_day = fields[2][0] == '*';
+    any_weekday = fields[4][0] == '*';
+}
+
+bool cm::cron_schedule::day_matches(int day_of_month, int day_of_week) const {
+    if (any_day && any_weekday)
+        return true;
+    if (any_day)
+        return weekdays[day_of_week];
+    if (any_weekday)
+        return days[day_of_month];
+    return days[day_of_month] || weekdays[day_of_week];
+}
+
+cm::cron_schedule::clock::time_point cm::cron_schedule::next(clock::time_point after) const {
+
+    std::time_t t = clock::to_time_t(after);
+    std::tm tm{};
+    ::localtime_r(&t, &tm);
+    tm.tm_sec = 0;
+    tm.tm_min++;
+
+    // mktime normalizes overflowing fields, e.g. minute 60 into the next hour, and sets the weekday.
+    // skipping a whole month, day or hour at once keeps this at a few dozen steps
+    auto normalize = [&tm]() {
+        tm.tm_isdst = -1;
+        return std::mktime(&tm);
+    };
+
+    std::time_t candidate = normalize();
+    const int last_year = tm.tm_year + 5;
+
+    // every step moves forward, the bound only guards against a time zone going in circles
+    for (int step = 0; step < 100000 && candidate != -1 && tm.tm_year <= last_year; step++) {
+        if (!months[tm.tm_mon + 1]) {
+            tm.tm_mon++;
+            tm.tm_mday = 1;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+        } else if (!day_matches(tm.tm_mday, tm.tm_wday)) {
+            tm.tm_mday++;
+            tm.tm_hour = 0;
+            tm.tm_min = 0;
+        } else if (!hours[tm.tm_hour]) {
+            tm.tm_hour++;
+            tm.tm_min = 0;
+        } else if (!minutes[tm.tm_min]) {
+            tm.tm_min++;
+        } else {
+            return clock::from_time_t(candidate);
+        }
+        candidate = normalize();
+    }
+
+    return clock::time_point::max();
+}
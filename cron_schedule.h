@@ -0,0 +1,54 @@
+#ifndef CM_CRON_SCHEDULE_H
+#define CM_CRON_SCHEDULE_H
+
+#include <bitset>
+#include <chrono>
+#include <string>
+
+namespace cm {
+
+    /**
+     * A schedule in crontab syntax: minute, hour, day of month, month and day of week, each a list of
+     * values, ranges and steps like "0,30", "1-5" or "0-59/15", months and weekdays also by name. @hourly,
+     * @daily, @weekly, @monthly and @yearly stand for their usual expansion. Like cron, a time matches
+     * either day field when both are restricted. Times are local time of cm.
+     */
+    class cron_schedule {
+
+    public:
+        typedef std::chrono::system_clock clock;
+
+        /**
+         * Throws std::invalid_argument naming the offending field.
+         */
+        explicit cron_schedule(const std::string &expression);
+
+        /**
+         * Returns the first full minute after the given time matching the schedule, or
+         * clock::time_point::max() if there is none within the next five years, like for "0 0 30 2 *".
+         */
+        [[nodiscard]] clock::time_point next(clock::time_point after) const;
+
+        [[nodiscard]] const std::string &expression() const {
+            return source;
+        }
+
+        bool operator==(const cron_schedule &other) const {
+            return source == other.source;
+        }
+
+    private:
+        [[nodiscard]] bool day_matches(int day_of_month, int day_of_week) const;
+
+        std::string source;
+        std::bitset<60> minutes;
+        std::bitset<24> hours;
+        std::bitset<32> days;
+        std::bitset<13> months;
+        std::bitset<7> weekdays;
+        // the day field was *, only the other one restricts the day
+        bool any_day = false, any_weekday = false;
+    };
+}
+
+#endif //CM_CRON_SCHEDULE_H
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <cmath>
+#include "latency_histogram.h"
+
+namespace {
+
+    const std::int64_t sub_buckets = 1 << cm::latency_histogram::sub_bucket_bits;
+
+    std::size_t index_of(std::int64_t ns) {
+        if (ns < sub_buckets)
+            return static_cast<std::size_t>(std::max<std::int64_t>(ns, 0));
+        if (ns >= std::int64_t(1) << cm::latency_histogram::max_bits)
+            return cm::latency_histogram::bucket_count - 1;
+
+        // the highest bit selects the power of two, the next sub_bucket_bits the bucket within it
+        int msb = 63 - __builtin_clzll(static_cast<unsigned long long>(ns));
+        int shift = msb - cm::latency_histogram::sub_bucket_bits;
+        return static_cast<std::size_t>((shift + 1) * sub_buckets + ((ns >> shift) - sub_buckets));
+    }
+
+    std::int64_t highest_of(std::size_t index) {
+        auto group = static_cast<std::int64_t>(index) / sub_buckets;
+        auto sub = static_cast<std::int64_t>(index) % sub_buckets;
+        if (group == 0)
+            return sub;
+
+        int shift = static_cast<int>(group) - 1;
+        return ((sub_buckets + sub) << shift) + (std::int64_t(1) << shift) - 1;
+    }
+}
+
+void cm::latency_histogram::record(std::int64_t ns) {
+    counts[index_of(ns)].fetch_add(1, std::memory_order_relaxed);
+}
+
+cm::latency_histogram::snapshot cm::latency_histogram::take() const {
+    snapshot s;
+    for (std::size_t i = 0; i < bucket_count; i++) {
+        s.counts[i] = counts[i].load(std::memory_order_relaxed);
+        s.total += s.counts[i];
+    }
+    return s;
+}
+
+std::int64_t cm::latency_histogram::snapshot::percentile(double p) const {
+    if (total == 0)
+        return 0;
+
+    auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(p * static_cast<double>(total))));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < bucket_count; i++) {
+        seen += counts[i];
+        if (seen >= rank)
+            return highest_of(i);
+    }
+    return max();
+}
+
+std::int64_t cm::latency_histogram::snapshot::max() const {
+    for (std::size_t i = bucket_count; i > 0; i--)
+        if (counts[i - 1] > 0)
+            return highest_of(i - 1);
+    return 0;
+}
+
+cm::latency_histogram::snapshot cm::latency_histogram::snapshot::operator-(const snapshot &earlier) const {
+    snapshot s;
+    for (std::size_t i = 0; i < bucket_count; i++) {
+        s.counts[i] = counts[i] - earlier.counts[i];
+        s.total += s.counts[i];
+    }
+    return s;
+}
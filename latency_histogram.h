@@ -0,0 +1,59 @@
+#ifndef CM_LATENCY_HISTOGRAM_H
+#define CM_LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace cm {
+
+    /**
+     * Histogram of latencies in nanoseconds with log-linear buckets like HdrHistogram: every power
+     * of two is split into 32 buckets, so a percentile is off by at most 1/32 of its value. Values
+     * beyond ~18 minutes end up in the last bucket. Recording is one relaxed atomic increment and
+     * can be done from any thread.
+     */
+    class latency_histogram {
+
+    public:
+        static const int sub_bucket_bits = 5;
+        static const int max_bits = 40;
+        static const std::size_t bucket_count = (max_bits - sub_bucket_bits + 1) << sub_bucket_bits;
+
+        /**
+         * Counts copied out of a histogram. Subtracting an earlier snapshot gives the values
+         * recorded in between.
+         */
+        struct snapshot {
+            std::array<std::uint64_t, bucket_count> counts{};
+            std::uint64_t total = 0;
+
+            /**
+             * Highest value of the bucket holding the p-th fraction (0..1) of all values, 0 if empty.
+             */
+            [[nodiscard]] std::int64_t percentile(double p) const;
+
+            [[nodiscard]] std::int64_t max() const;
+
+            snapshot operator-(const snapshot &earlier) const;
+        };
+
+        void record(std::int64_t ns);
+
+        [[nodiscard]] snapshot take() const;
+
+    private:
+        std::array<std::atomic<std::uint64_t>, bucket_count> counts{};
+    };
+
+    /**
+     * When the chunk a line came from was read (steady_clock), and the histogram of its app which
+     * receives the time until the line was written.
+     */
+    struct line_origin {
+        latency_histogram *latency;
+        std::int64_t read_ns;
+    };
+}
+
+#endif //CM_LATENCY_HISTOGRAM_H
@@ -0,0 +1,142 @@
+#include <cstring>
+#include "line_buffer.h"
+
+namespace {
+    const std::string_view truncation_marker = " [truncated]";
+}
+
+cm::line_buffer::line_buffer(buffer_pool &pool, const limits &lim)
+        : pool(pool), lim(lim) {
+}
+
+boost::asio::mutable_buffer cm::line_buffer::prepare() {
+
+    std::size_t used = tail - head;
+    std::size_t want = std::min(read_size, lim.max_buffered - used);
+
+    if (storage.size() - tail < want) {
+        if (used + want <= storage.size()) {
+            std::memmove(storage.data(), storage.data() + head, used);
+        } else {
+            auto larger = pool.acquire(used + want);
+            if (used > 0)
+                std::memcpy(larger.data(), storage.data() + head, used);
+            storage = std::move(larger);
+        }
+        scan -= head;
+        head = 0;
+        tail = used;
+    }
+
+    prepared = std::min(storage.size() - tail, lim.max_buffered - used);
+    return boost::asio::buffer(storage.data() + tail, prepared);
+}
+
+bool cm::line_buffer::commit(std::size_t len, const line_callback_type &cb) {
+
+    if (len > 0) {
+        if (len == prepared && read_size < buffer_pool::max_slab_size)
+            read_size *= 2;
+        else if (len < read_size / 4 && read_size > buffer_pool::min_slab_size)
+            read_size /= 2;
+    }
+
+    const char *base = storage.data();
+    tail += len;
+    bool go_on = true;
+
+    while (go_on && scan < tail) {
+        auto *line_break = static_cast<const char *>(std::memchr(base + scan, '\n', tail - scan));
+
+        if (line_break == nullptr) {
+            scan = tail;
+            break;
+        }
+
+        auto end = static_cast<std::size_t>(line_break - base);
+        if (discarding)
+            discarding = false;
+        else
+            go_on = emit(std::string_view(base + head, end - head), cb);
+        head = scan = end + 1;
+    }
+
+    // the unfinished line already hit the limit, don't wait for its line break
+    if (go_on && scan == tail) {
+        if (discarding) {
+            head = tail;
+        } else if (tail - head >= lim.max_line_length) {
+            if (lim.truncate) {
+                go_on = truncated(std::string_view(base + head, lim.max_line_length), cb);
+                discarding = true;
+                head = tail;
+            } else {
+                while (tail - head >= lim.max_line_length) {
+                    go_on = cb(std::string_view(base + head, lim.max_line_length));
+                    head += lim.max_line_length;
+                }
+            }
+        }
+    }
+
+    if (head == tail)
+        head = tail = scan = 0;
+
+    return go_on;
+}
+
+bool cm::line_buffer::emit(std::string_view line, const line_callback_type &cb) {
+
+    if (line.size() <= lim.max_line_length)
+        return cb(line);
+
+    if (lim.truncate)
+        return truncated(line.substr(0, lim.max_line_length), cb);
+
+    bool go_on = true;
+    while (!line.empty()) {
+        go_on = cb(line.substr(0, lim.max_line_length));
+        line.remove_prefix(std::min(line.size(), lim.max_line_length));
+    }
+    return go_on;
+}
+
+bool cm::line_buffer::truncated(std::string_view line, const line_callback_type &cb) {
+    scratch.assign(line.data(), line.size());
+    scratch.append(truncation_marker);
+    return cb(scratch);
+}
+
+void cm::line_buffer::flush(const line_callback_type &cb) {
+    const char *base = storage.data();
+
+    // complete lines held back by the consumer first
+    while (scan < tail) {
+        auto *line_break = static_cast<const char *>(std::memchr(base + scan, '\n', tail - scan));
+        if (line_break == nullptr)
+            break;
+
+        auto end = static_cast<std::size_t>(line_break - base);
+        if (discarding)
+            discarding = false;
+        else
+            emit(std::string_view(base + head, end - head), cb);
+        head = scan = end + 1;
+    }
+
+    if (head != tail && !discarding)
+        emit(std::string_view(base + head, tail - head), cb);
+
+    head = tail = scan = 0;
+    discarding = false;
+    storage = buffer_pool::slab();
+}
+
+void cm::line_buffer::release_if_empty() {
+    if (head == tail)
+        storage = buffer_pool::slab();
+}
+
+std::size_t cm::line_buffer::buffered() const {
+    return tail - head;
+}
@@ -2,41 +2,81 @@
 #define CM_LINE_BUFFER_H
 
 #include <functional>
-#include <map>
+#include <string_view>
+#include <boost/asio/buffer.hpp>
+#include "buffer_pool.h"
 
 namespace cm {
 
-    template<typename MutableBuffer>
+    /**
+     * Splits a byte stream into lines. Reads go directly into the free tail of the
+     * internal storage (prepare/commit), complete lines are handed out as views into
+     * that storage and the unfinished rest is moved to the front once the tail is used up.
+     *
+     * The storage is a slab from a shared buffer_pool. The size offered to reads grows while
+     * reads keep filling it and shrinks again when they don't, and the slab goes back to the
+     * pool whenever no partial line is buffered.
+     *
+     * Lines longer than max_line_length are split into several lines or truncated, and the
+     * storage never grows beyond max_buffered bytes.
+     */
     class line_buffer {
 
     public:
-        typedef std::function<void(std::string)> line_callback_type;
-        typedef MutableBuffer buffer_type;
+        /**
+         * Receives one line. Returning false stops the buffer from handing out further lines
+         * until the next commit, the remaining data stays buffered.
+         */
+        typedef std::function<bool(std::string_view)> line_callback_type;
 
-        void available(const std::string &stream_identifier, const buffer_type &new_data, const line_callback_type &cb);
+        struct limits {
+            std::size_t max_line_length = 1024 * 1024;
+            std::size_t max_buffered = 2 * 1024 * 1024;
+            bool truncate = false;
+        };
 
-    private:
-        std::map<std::string, buffer_type> data;
+        line_buffer(buffer_pool &pool, const limits &lim);
 
-    };
+        /**
+         * Returns the writable region behind the buffered data. Compacts or grows the storage
+         * if less than the current read size is left.
+         */
+        boost::asio::mutable_buffer prepare();
 
-    template<typename MutableBuffer>
-    void line_buffer<MutableBuffer>::available(const std::string &stream_identifier, const buffer_type &new_data,
-                                               const line_buffer::line_callback_type &cb) {
-        std::copy(new_data.begin(), new_data.end(), std::back_inserter(data[stream_identifier]));
-        buffer_type &s = data.at(stream_identifier);
+        /**
+         * Marks len bytes of the region returned by prepare() as written and calls cb for
+         * every complete line. The views are only valid during the callback.
+         * Returns false if cb asked to stop. commit(0, cb) continues with the held back lines.
+         */
+        bool commit(std::size_t len, const line_callback_type &cb);
 
-        while (true) {
-            auto first_line_break = std::find(s.begin(), s.end(), '\n');
+        /**
+         * Passes all remaining lines, including a trailing line without line break, to cb.
+         * Used when the stream is closed.
+         */
+        void flush(const line_callback_type &cb);
 
-            if (first_line_break == s.end()) {
-                return;
-            }
+        /**
+         * Returns the storage to the pool if no partial line is buffered.
+         */
+        void release_if_empty();
 
-            cb(std::string(s.begin(), first_line_break));
-            s.erase(s.begin(), first_line_break + 1);
-        }
-    }
+        [[nodiscard]] std::size_t buffered() const;
+
+    private:
+        bool emit(std::string_view line, const line_callback_type &cb);
+
+        bool truncated(std::string_view line, const line_callback_type &cb);
+
+        buffer_pool &pool;
+        const limits lim;
+        std::string scratch;
+        bool discarding = false;
+        buffer_pool::slab storage;
+        std::size_t head = 0, tail = 0, scan = 0;
+        std::size_t read_size = buffer_pool::min_slab_size;
+        std::size_t prepared = 0;
+    };
 }
 
 #endif //CM_LINE_BUFFER_H
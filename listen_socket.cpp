@@ -0,0 +1,97 @@
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <boost/asio/ip/tcp.hpp>
+#include "listen_socket.h"
+
+namespace {
+
+    boost::asio::ip::tcp::endpoint parse_tcp(const std::string &address) {
+        auto colon = address.rfind(':');
+        auto host = colon == std::string::npos ? std::string() : address.substr(0, colon);
+        auto port = colon == std::string::npos ? address : address.substr(colon + 1);
+        if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+            host = host.substr(1, host.size() - 2);
+
+        std::size_t end = 0;
+        unsigned long number = 0;
+        try {
+            number = std::stoul(port, &end);
+        } catch (const std::logic_error &) {
+        }
+        if (port.empty() || end != port.size() || number == 0 || number > 65535)
+            throw std::invalid_argument("invalid port in " + address);
+
+        boost::system::error_code ec;
+        auto ip = boost::asio::ip::make_address(host.empty() ? "0.0.0.0" : host, ec);
+        if (ec)
+            throw std::invalid_argument("invalid address in " + address);
+
+        return {ip, static_cast<unsigned short>(number)};
+    }
+
+    sockaddr_un parse_unix(const std::string &address) {
+        sockaddr_un sun{};
+        if (address.size() >= sizeof(sun.sun_path))
+            throw std::invalid_argument("unix socket path too long: " + address);
+        sun.sun_family = AF_UNIX;
+        std::memcpy(sun.sun_path, address.c_str(), address.size() + 1);
+        return sun;
+    }
+}
+
+void cm::listen_socket::validate(const std::string &address) {
+    if (is_unix(address))
+        parse_unix(address);
+    else
+        parse_tcp(address);
+}
+
+cm::listen_socket::listen_socket(std::string address)
+        : addr(std::move(address)) {
+
+    auto fail = [this](const char *call) {
+        std::system_error e(errno, std::generic_category(), std::string(call) + " " + addr);
+        if (sock != -1)
+            ::close(sock);
+        throw e;
+    };
+
+    // cloexec: only the children of the app get it, moved to fd 3 and up
+    if (is_unix(addr)) {
+        auto sun = parse_unix(addr);
+        unix_path = std::make_unique<socket_path>(addr);
+        sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock == -1)
+            fail("socket");
+        if (::bind(sock, reinterpret_cast<sockaddr *>(&sun), sizeof(sun)) == -1)
+            fail("bind");
+        try {
+            unix_path->bound();
+        } catch (...) {
+            ::close(sock);
+            throw;
+        }
+    } else {
+        auto endpoint = parse_tcp(addr);
+        sock = ::socket(endpoint.protocol().family(), SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock == -1)
+            fail("socket");
+        int on = 1;
+        if (::setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1 ||
+            ::setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1)
+            fail("setsockopt");
+        if (::bind(sock, endpoint.data(), endpoint.size()) == -1)
+            fail("bind");
+    }
+
+    if (::listen(sock, SOMAXCONN) == -1)
+        fail("listen");
+}
+
+cm::listen_socket::~listen_socket() {
+    ::close(sock);
+}
@@ -0,0 +1,59 @@
+#ifndef CM_LISTEN_SOCKET_H
+#define CM_LISTEN_SOCKET_H
+
+#include <memory>
+#include <string>
+#include "socket_path.h"
+
+namespace cm {
+
+    /**
+     * A listening socket cm binds for an app and passes to every start of it, so connections queue up
+     * in the kernel while the app restarts instead of being refused. The address is a port, host:port,
+     * [v6]:port or the path of a unix socket. TCP sockets are bound with SO_REUSEPORT, the sockets of
+     * several replicas on the same port form a group the kernel balances connections over.
+     */
+    class listen_socket {
+
+    public:
+        listen_socket(const listen_socket &) = delete;
+
+        /**
+         * Throws std::system_error if the socket can't be bound. An existing unix socket path is only
+         * replaced if it is a socket nobody accepts on anymore.
+         */
+        explicit listen_socket(std::string address);
+
+        /**
+         * Closes the socket. A unix socket's path is removed if it is still the socket cm bound.
+         */
+        ~listen_socket();
+
+        /**
+         * Throws std::invalid_argument if address is neither a port, host:port nor an absolute path.
+         */
+        static void validate(const std::string &address);
+
+        /**
+         * Unix sockets can't share a path, all replicas get the same socket.
+         */
+        static bool is_unix(const std::string &address) {
+            return !address.empty() && address.front() == '/';
+        }
+
+        [[nodiscard]] int fd() const {
+            return sock;
+        }
+
+        [[nodiscard]] const std::string &address() const {
+            return addr;
+        }
+
+    private:
+        std::string addr;
+        int sock = -1;
+        std::unique_ptr<socket_path> unix_path;
+    };
+}
+
+#endif //CM_LISTEN_SOCKET_H
@@ -0,0 +1,119 @@
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <sys/time.h>
+#include "log_format.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+std::size_t cm::find_json_escape(std::string_view s) {
+
+    const auto *p = reinterpret_cast<const unsigned char *>(s.data());
+    std::size_t n = s.size(), i = 0;
+
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        // unsigned v <= 0x1f  <=>  max(v, 0x1f) == 0x1f
+        __m128i hit = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask != 0)
+            return i + __builtin_ctz(static_cast<unsigned>(mask));
+    }
+#endif
+
+    for (; i < n; i++) {
+        if (p[i] < 0x20 || p[i] == '"' || p[i] == '\\')
+            return i;
+    }
+
+    return n;
+}
+
+void cm::append_number(std::string &out, double value) {
+
+    char buf[32];
+    std::to_chars_result result{};
+
+    if (value == std::floor(value) && std::fabs(value) < 9007199254740992.0)
+        result = std::to_chars(buf, buf + sizeof(buf), static_cast<long long>(value));
+    else
+        result = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::fixed, 2);
+
+    out.append(buf, result.ptr - buf);
+}
+
+void cm::append_json_escaped(std::string &out, std::string_view s) {
+
+    static const char hex[] = "0123456789abcdef";
+
+    while (!s.empty()) {
+        std::size_t clean = find_json_escape(s);
+        out.append(s.data(), clean);
+
+        if (clean == s.size())
+            return;
+
+        auto c = static_cast<unsigned char>(s[clean]);
+        switch (c) {
+            case '"':
+                out.append("\\\"");
+                break;
+            case '\\':
+                out.append("\\\\");
+                break;
+            case '\n':
+                out.append("\\n");
+                break;
+            case '\r':
+                out.append("\\r");
+                break;
+            case '\t':
+                out.append("\\t");
+                break;
+            case '\b':
+                out.append("\\b");
+                break;
+            case '\f':
+                out.append("\\f");
+                break;
+            default: {
+                char u[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+                out.append(u, sizeof(u));
+            }
+        }
+
+        s.remove_prefix(clean + 1);
+    }
+}
+
+void cm::timestamp_formatter::append(std::string &out) {
+
+    struct timeval tv{};
+    gettimeofday(&tv, nullptr);
+
+    if (tv.tv_sec != cached_second) {
+        struct tm local{};
+        localtime_r(&tv.tv_sec, &local);
+        prefix_len = std::strftime(prefix, sizeof(prefix), "%Y-%m-%dT%H:%M:%S.", &local);
+        cached_second = tv.tv_sec;
+    }
+
+    char micros[6];
+    auto us = static_cast<unsigned>(tv.tv_usec);
+    for (int i = 5; i >= 0; i--) {
+        micros[i] = static_cast<char>('0' + us % 10);
+        us /= 10;
+    }
+
+    out.append(prefix, prefix_len);
+    out.append(micros, sizeof(micros));
+}
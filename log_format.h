@@ -0,0 +1,42 @@
+#ifndef CM_LOG_FORMAT_H
+#define CM_LOG_FORMAT_H
+
+#include <string>
+#include <string_view>
+#include <ctime>
+
+namespace cm {
+
+    /**
+     * Returns the offset of the first byte in s which needs escaping inside a json string
+     * (control characters, quote and backslash) or s.size() if there is none.
+     */
+    std::size_t find_json_escape(std::string_view s);
+
+    /**
+     * Appends s to out with json string escaping applied. UTF-8 sequences are passed through.
+     */
+    void append_json_escaped(std::string &out, std::string_view s);
+
+    /**
+     * Appends value as json number: integral values without decimals, others with two decimals.
+     */
+    void append_number(std::string &out, double value);
+
+    /**
+     * Formats the current local time as ISO 8601 extended with microseconds
+     * (2020-01-14T10:00:00.123456). Date and seconds are only formatted again when the second changes.
+     */
+    class timestamp_formatter {
+
+    public:
+        void append(std::string &out);
+
+    private:
+        std::time_t cached_second = -1;
+        char prefix[32] = {};
+        std::size_t prefix_len = 0;
+    };
+}
+
+#endif //CM_LOG_FORMAT_H
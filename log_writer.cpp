@@ -0,0 +1,220 @@
+#include <cerrno>
+#include <climits>
+#include <vector>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "log_writer.h"
+
+namespace {
+    // capacity a cell keeps for the next record. longer records are released after writing, a burst of
+    // long lines would otherwise pin queue_size times max-line-length
+    const std::size_t cell_capacity = 4096;
+
+    std::size_t round_up_to_power_of_two(std::size_t n) {
+        std::size_t p = 2;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+}
+
+cm::log_writer::log_writer(const options &opts)
+        : opts(opts), mask(round_up_to_power_of_two(opts.queue_size) - 1),
+          cells(new cell[mask + 1]) {
+
+    for (std::size_t i = 0; i <= mask; i++)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+
+    thread = std::thread([this]() { run(); });
+}
+
+cm::log_writer::~log_writer() {
+    stopping.store(true);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        wakeup.notify_one();
+    }
+    thread.join();
+}
+
+bool cm::log_writer::push(int fd, std::string_view record, const line_origin *from) {
+
+    std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    cell *c;
+
+    while (true) {
+        c = &cells[pos & mask];
+        std::size_t seq = c->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+
+        if (diff == 0) {
+            if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            dropped_total.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    // the string keeps up to cell_capacity while the cell is recycled, so usual lines only allocate
+    // during warm up
+    c->fd = fd;
+    c->pushed = std::chrono::steady_clock::now();
+    c->from = from ? *from : line_origin{nullptr, 0};
+    c->data.assign(record.data(), record.size());
+    c->sequence.store(pos + 1, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        wakeup.notify_one();
+    }
+
+    return true;
+}
+
+void cm::log_writer::flush() {
+    std::size_t queued = enqueue_pos.load();
+    while (dequeued.load() < queued)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+bool cm::log_writer::congested() const {
+    std::size_t queued = enqueue_pos.load(std::memory_order_relaxed) - dequeued.load(std::memory_order_relaxed);
+    return queued > (mask + 1) / 4 * 3;
+}
+
+cm::log_writer::statistics cm::log_writer::stats() const {
+    statistics s;
+    // dequeued first, enqueue_pos never falls behind it
+    s.written = dequeued.load(std::memory_order_relaxed);
+    s.queued = enqueue_pos.load(std::memory_order_relaxed) - s.written;
+    s.dropped = dropped_total.load(std::memory_order_relaxed);
+    s.latency = std::chrono::nanoseconds(latency_ns.load(std::memory_order_relaxed));
+    return s;
+}
+
+std::size_t cm::log_writer::ready(std::size_t max) const {
+    std::size_t n = 0;
+
+    while (n < max) {
+        std::size_t pos = dequeue_pos + n;
+        if (cells[pos & mask].sequence.load(std::memory_order_acquire) != pos + 1)
+            break;
+        n++;
+    }
+
+    return n;
+}
+
+void cm::log_writer::run() {
+
+    while (true) {
+        std::size_t n = ready(opts.batch_size);
+
+        if (n == 0) {
+            if (stopping.load())
+                break;
+            wait(1, std::chrono::steady_clock::time_point::max());
+            continue;
+        }
+
+        // give the batch a chance to fill up before paying for the syscall
+        if (n < opts.batch_size && opts.flush_latency.count() > 0 && !stopping.load()) {
+            wait(opts.batch_size, std::chrono::steady_clock::now() + opts.flush_latency);
+            n = ready(opts.batch_size);
+        }
+
+        write_batch(n);
+
+        std::size_t lost = dropped.exchange(0, std::memory_order_relaxed);
+        if (lost > 0) {
+            std::string notice = "cm: log queue full, dropped " + std::to_string(lost) + " records\n";
+            struct iovec iov = {notice.data(), notice.size()};
+            write_all(STDERR_FILENO, &iov, 1);
+        }
+    }
+}
+
+void cm::log_writer::write_batch(std::size_t count) {
+
+    std::vector<struct iovec> iov;
+    iov.reserve(count);
+
+    std::size_t i = 0;
+    while (i < count) {
+        int fd = cells[(dequeue_pos + i) & mask].fd;
+        iov.clear();
+
+        for (; i < count && iov.size() < IOV_MAX; i++) {
+            cell &c = cells[(dequeue_pos + i) & mask];
+            if (c.fd != fd)
+                break;
+            iov.push_back({c.data.data(), c.data.size()});
+        }
+
+        write_all(fd, iov.data(), static_cast<int>(iov.size()));
+    }
+
+    auto written = std::chrono::steady_clock::now();
+    std::chrono::nanoseconds latency{0};
+
+    for (i = 0; i < count; i++) {
+        std::size_t pos = dequeue_pos + i;
+        cell &c = cells[pos & mask];
+        latency += written - c.pushed;
+        if (c.from.latency)
+            c.from.latency->record(written.time_since_epoch().count() - c.from.read_ns);
+        if (c.data.capacity() > cell_capacity)
+            std::string().swap(c.data);
+        c.sequence.store(pos + mask + 1, std::memory_order_release);
+    }
+
+    latency_ns.fetch_add(latency.count(), std::memory_order_relaxed);
+
+    dequeue_pos += count;
+    dequeued.store(dequeue_pos, std::memory_order_relaxed);
+}
+
+void cm::log_writer::write_all(int fd, struct iovec *iov, int count) {
+
+    while (count > 0) {
+        ssize_t written = ::writev(fd, iov, count);
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        auto left = static_cast<std::size_t>(written);
+        while (count > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            iov++;
+            count--;
+        }
+
+        if (count > 0) {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+}
+
+void cm::log_writer::wait(std::size_t wanted, std::chrono::steady_clock::time_point deadline) {
+
+    std::unique_lock<std::mutex> lock(mutex);
+    sleeping.store(true);
+
+    auto done = [this, wanted]() { return stopping.load() || ready(wanted) >= wanted; };
+
+    if (deadline == std::chrono::steady_clock::time_point::max())
+        wakeup.wait(lock, done);
+    else
+        wakeup.wait_until(lock, deadline, done);
+
+    sleeping.store(false);
+}
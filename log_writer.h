@@ -0,0 +1,102 @@
+#ifndef CM_LOG_WRITER_H
+#define CM_LOG_WRITER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "latency_histogram.h"
+
+namespace cm {
+
+    /**
+     * Moves formatted log records off the calling thread. Records are pushed into a bounded
+     * lock-free queue and written by a dedicated thread in batches using writev. When the queue
+     * is full (e.g. stdout is blocked) records are dropped and counted instead of blocking the caller.
+     */
+    class log_writer {
+
+    public:
+        struct options {
+            std::size_t queue_size = 8192;
+            std::size_t batch_size = 64;
+            std::chrono::microseconds flush_latency{0};
+        };
+
+        struct statistics {
+            std::size_t queued = 0, written = 0, dropped = 0;
+            // sum over all written records of the time from push to writev returning
+            std::chrono::nanoseconds latency{0};
+        };
+
+        explicit log_writer(const options &opts);
+
+        log_writer(const log_writer &) = delete;
+
+        /**
+         * Stops the writer thread after all queued records were written.
+         */
+        ~log_writer();
+
+        /**
+         * Queues record for fd. Safe to call from multiple threads. If from is given, its histogram
+         * receives the time from the read of the line to the write of the record.
+         * Returns false if the queue is full and the record was dropped.
+         */
+        bool push(int fd, std::string_view record, const line_origin *from = nullptr);
+
+        /**
+         * Waits until everything queued so far was written.
+         */
+        void flush();
+
+        /**
+         * True while the queue is more than three quarters full. Producers which can wait
+         * (child output) should stop reading until it clears instead of losing records.
+         */
+        [[nodiscard]] bool congested() const;
+
+        [[nodiscard]] statistics stats() const;
+
+    private:
+        struct cell {
+            std::atomic<std::size_t> sequence;
+            int fd;
+            std::chrono::steady_clock::time_point pushed;
+            line_origin from;
+            std::string data;
+        };
+
+        void run();
+
+        std::size_t ready(std::size_t max) const;
+
+        void write_batch(std::size_t count);
+
+        void write_all(int fd, struct iovec *iov, int count);
+
+        void wait(std::size_t wanted, std::chrono::steady_clock::time_point deadline);
+
+        const options opts;
+        const std::size_t mask;
+        std::unique_ptr<cell[]> cells;
+
+        alignas(64) std::atomic<std::size_t> enqueue_pos{0};
+        alignas(64) std::size_t dequeue_pos = 0;
+        std::atomic<std::size_t> dequeued{0};
+
+        std::atomic<std::size_t> dropped{0}, dropped_total{0};
+        std::atomic<std::int64_t> latency_ns{0};
+        std::atomic_bool sleeping{false};
+        std::atomic_bool stopping{false};
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        std::thread thread;
+    };
+}
+
+#endif //CM_LOG_WRITER_H
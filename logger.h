@@ -5,11 +5,16 @@
 #ifndef CM_LOGGER_H
 #define CM_LOGGER_H
 
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/json_parser.hpp>
+#include <iostream>
 #include <ostream>
-#include <boost/date_time.hpp>
-#include <boost/date_time/posix_time/posix_time.hpp>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <unistd.h>
+#include "latency_histogram.h"
+#include "log_format.h"
+#include "log_writer.h"
 
 namespace cm {
 
@@ -20,7 +25,7 @@ namespace cm {
             STDOUT, STDERR
         };
 
-        static std::string stream_to_string(const logger::stream s) {
+        static std::string_view stream_to_string(const logger::stream s) {
             switch (s) {
                 case logger::stream::STDERR:
                     return "stderr";
@@ -31,16 +36,85 @@ namespace cm {
             }
         }
 
-        virtual void log(stream s, const std::string &context, const std::string &line) const = 0;
+        typedef std::pair<std::string_view, double> value;
 
-        void err(const std::string &context, const std::string &line) {
-            log(stream::STDERR, context, line);
+        /**
+         * Logs a line. If from is given, the time from the read of the line until its record is
+         * written is recorded in from's histogram.
+         */
+        virtual void log(stream s, const std::string &context, std::string_view line,
+                         const line_origin *from = nullptr) const = 0;
+
+        /**
+         * Logs a message with named numbers, e.g. resource usage. json records carry them as
+         * fields of their own, simple records as key=value pairs after the message.
+         */
+        virtual void log(stream s, const std::string &context, std::string_view message,
+                         std::initializer_list<value> values) const = 0;
+
+        void err(const std::string &context, std::string_view line, const line_origin *from = nullptr) {
+            log(stream::STDERR, context, line, from);
+        }
+
+        void out(const std::string &context, std::string_view line, const line_origin *from = nullptr) {
+            log(stream::STDOUT, context, line, from);
+        }
+
+        /**
+         * Hands formatted records to writer instead of writing them on the calling thread.
+         */
+        void set_writer(std::shared_ptr<log_writer> w) {
+            writer = std::move(w);
+        }
+
+        /**
+         * Waits until the records handed to the writer were written.
+         */
+        void flush() {
+            if (writer)
+                writer->flush();
+        }
+
+        /**
+         * True if records are currently produced faster than they can be written.
+         */
+        [[nodiscard]] bool congested() const {
+            return writer && writer->congested();
         }
 
-        void out(const std::string &context, const std::string &line) {
-            log(stream::STDOUT, context, line);
+        /**
+         * Records written so far and their latency. Without writer the latency is the time spent
+         * in the synchronous write.
+         */
+        [[nodiscard]] log_writer::statistics stats() const {
+            if (writer)
+                return writer->stats();
+
+            std::lock_guard<std::mutex> lock(write_mutex);
+            return sync_stats;
+        }
+
+    protected:
+        void write(int fd, std::ostream &os, std::string_view record, const line_origin *from = nullptr) const {
+            if (writer) {
+                writer->push(fd, record, from);
+            } else {
+                std::lock_guard<std::mutex> lock(write_mutex);
+                auto begin = std::chrono::steady_clock::now();
+                os << record << std::flush;
+                auto written = std::chrono::steady_clock::now();
+                sync_stats.written++;
+                sync_stats.latency += written - begin;
+                if (from)
+                    from->latency->record(written.time_since_epoch().count() - from->read_ns);
+            }
         }
 
+    private:
+        std::shared_ptr<log_writer> writer;
+        mutable std::mutex write_mutex;
+        mutable log_writer::statistics sync_stats;
+
     };
 
 
@@ -50,19 +124,45 @@ namespace cm {
         explicit json_logger(std::ostream &out) : out(out) {
         }
 
-        void log(logger::stream s, const std::string &context, const std::string &line) const override {
-            boost::property_tree::ptree tree;
-
-            tree.put("stream", logger::stream_to_string(s));
-            tree.put("context", context);
-            tree.put("message", line);
-            tree.put("time",
-                     boost::posix_time::to_iso_extended_string(boost::posix_time::microsec_clock::local_time()));
+        void log(logger::stream s, const std::string &context, std::string_view line,
+                 const line_origin *from) const override {
+            thread_local std::string record;
+            thread_local timestamp_formatter time;
+
+            record.clear();
+            record.append(R"({"stream":")").append(logger::stream_to_string(s));
+            record.append(R"(","context":")");
+            append_json_escaped(record, context);
+            record.append(R"(","message":")");
+            append_json_escaped(record, line);
+            record.append(R"(","time":")");
+            time.append(record);
+            record.append("\"}\n");
+
+            write(STDOUT_FILENO, out, record, from);
+        }
 
-            std::stringstream ss;
-            boost::property_tree::json_parser::write_json(ss, tree, false);
+        void log(logger::stream s, const std::string &context, std::string_view message,
+                 std::initializer_list<value> values) const override {
+            thread_local std::string record;
+            thread_local timestamp_formatter time;
+
+            record.clear();
+            record.append(R"({"stream":")").append(logger::stream_to_string(s));
+            record.append(R"(","context":")");
+            append_json_escaped(record, context);
+            record.append(R"(","message":")");
+            append_json_escaped(record, message);
+            record.append("\"");
+            for (const auto &v : values) {
+                record.append(",\"").append(v.first).append("\":");
+                append_number(record, v.second);
+            }
+            record.append(R"(,"time":")");
+            time.append(record);
+            record.append("\"}\n");
 
-            out << ss.str() << std::flush;
+            write(STDOUT_FILENO, out, record);
         }
 
     private:
@@ -74,14 +174,43 @@ namespace cm {
 
     public:
 
-        void log(stream s, const std::string &context, const std::string &line) const override {
-            std::string time = boost::posix_time::to_iso_extended_string(
-                    boost::posix_time::microsec_clock::local_time()
-            );
+        void log(stream s, const std::string &context, std::string_view line,
+                 const line_origin *from) const override {
+            thread_local std::string record;
+            thread_local timestamp_formatter time;
+
+            record.clear();
+            record.append("[");
+            time.append(record);
+            record.append("][").append(context).append("] ").append(line).append("\n");
+
+            write(s, record, from);
+        }
+
+        void log(stream s, const std::string &context, std::string_view message,
+                 std::initializer_list<value> values) const override {
+            thread_local std::string record;
+            thread_local timestamp_formatter time;
+
+            record.clear();
+            record.append("[");
+            time.append(record);
+            record.append("][").append(context).append("] ").append(message);
+            for (const auto &v : values) {
+                record.append(" ").append(v.first).append("=");
+                append_number(record, v.second);
+            }
+            record.append("\n");
+
+            write(s, record);
+        }
+
+    private:
+        void write(stream s, std::string_view record, const line_origin *from = nullptr) const {
             if (s == logger::stream::STDOUT)
-                std::cout << "[" << time << "][" << context << "] " << line << "\n" << std::flush;
+                logger::write(STDOUT_FILENO, std::cout, record, from);
             else if (s == logger::stream::STDERR)
-                std::cerr << "[" << time << "][" << context << "] " << line << "\n" << std::flush;
+                logger::write(STDERR_FILENO, std::cerr, record, from);
             else
                 abort();
         }
@@ -3,6 +3,11 @@
 #include "config_map.h"
 #include "application.h"
 #include "constants.h"
+#include "control.h"
+#include "trace.h"
+
+// 64 bytes each, startup and shutdown of a few hundred apps stay far below
+const std::size_t trace_buffer_events = 1 << 16;
 
 void show_version() {
     std::cout << cm::app_name << " " << cm::app_version << "\n";
@@ -11,19 +16,82 @@ void show_version() {
 void show_help(const std::string &program_name) {
     std::cout << "Usage: " << program_name << " [OPTION]... CONFIG-FILE\n"
               << "  or:  " << program_name << " -e [OPTION]...\n"
+              << "  or:  " << program_name << " ctl SOCKET COMMAND [ARGS]...\n"
+              << "  or:  " << program_name << " compile [-e] [CONFIG-FILE] -o SNAPSHOT\n"
               << "Options:\n"
               << "  -j             Use json for log output\n"
               << "  -s             Simple log output\n"
               << "  -e             Load configuration from environment variables\n"
+              << "  --trace FILE   Write a Chrome trace of startup and shutdown to FILE on exit\n"
               << "  -h, --help     Show this help\n"
-              << "  -v, --version  Show version information\n\n";
+              << "  -v, --version  Show version information\n\n"
+              << "compile writes a binary snapshot of the configuration, which is given as CONFIG-FILE\n"
+              << "to start without parsing yaml or searching executables.\n\n"
+              << "Commands of ctl, sent to the control-socket of a running " << cm::app_name << ":\n"
+              << "  status             Show state, pid, uptime and resource usage of all apps\n"
+              << "  start APP          Start an app which is not running\n"
+              << "  stop APP           Stop an app, it stays down until started again\n"
+              << "  restart APP        Stop an app and start it again\n"
+              << "  signal APP SIGNAL  Send a signal, by name or number, to an app\n"
+              << "  tail APP           Follow the output of an app\n\n";
+}
+
+int control(int argc, char *argv[]) {
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " ctl SOCKET COMMAND [ARGS]...\n";
+        return 1;
+    }
+
+    try {
+        return cm::control_request(argv[2], std::vector<std::string>(argv + 3, argv + argc), std::cout, std::cerr);
+    } catch (const boost::system::system_error &e) {
+        std::cerr << argv[2] << ": " << e.code().message() << "\n";
+        return 2;
+    }
+}
+
+int compile(int argc, char *argv[]) {
+    bool use_env = false;
+    std::string config_file, output;
+
+    for (int i = 2; i < argc; i++) {
+        std::string v = argv[i];
+        if (v == "-e")
+            use_env = true;
+        else if (v == "-o" && i + 1 < argc)
+            output = argv[++i];
+        else if (config_file.empty())
+            config_file = v;
+        else
+            std::cerr << "Invalid option: " << v << "\n";
+    }
+
+    if (output.empty() || config_file.empty() == !use_env) {
+        std::cerr << "Usage: " << argv[0] << " compile [-e] [CONFIG-FILE] -o SNAPSHOT\n";
+        return 1;
+    }
+
+    try {
+        auto config = use_env ? cm::config_map::from_environment() : cm::config_map::from_file(config_file);
+        config->write_snapshot(output);
+        std::cout << "Compiled " << config->apps.size() << " applications into " << output << "\n";
+        return 0;
+    } catch (const cm::config_map_exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
 }
 
 int main(int argc, char *argv[]) {
 
     bool use_json = false;
     bool use_env = false;
-    std::string config_file;
+    std::string config_file, trace_file;
+
+    if (argc > 1 && std::string(argv[1]) == "ctl")
+        return control(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "compile")
+        return compile(argc, argv);
 
     for (int i = 1; i < argc; i++) {
         std::string v = argv[i];
@@ -39,6 +107,9 @@ int main(int argc, char *argv[]) {
             use_json = true;
         } else if (v == "-e") {
             use_env = true;
+        } else if (v == "--trace" && i + 1 < argc) {
+            trace_file = argv[++i];
+            cm::trace::enable(trace_buffer_events);
         } else if (config_file.empty()) {
             config_file = v;
         } else {
@@ -46,6 +117,11 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    int status = 0;
+
+    // before the first thread is started, the log writer and the event loop threads inherit it
+    cm::reaper::block_sigchld();
+
     try {
         std::shared_ptr<cm::logger> log;
 
@@ -56,21 +132,45 @@ int main(int argc, char *argv[]) {
 
         std::shared_ptr<cm::config_map> config;
 
+        auto begin = std::chrono::steady_clock::now();
+
         if (use_env)
             config = cm::config_map::from_environment();
         else
             config = cm::config_map::from_file(config_file);
 
+        auto loaded = std::chrono::steady_clock::now();
+        cm::trace::complete("load configuration", "", begin, loaded);
+
+        char took[64];
+        std::snprintf(took, sizeof(took), "%.3f ms",
+                      std::chrono::duration<double, std::milli>(loaded - begin).count());
+        log->err(cm::app_name, "Loaded configuration of " + std::to_string(config->apps.size()) +
+                               " applications from " + (use_env ? std::string("environment") : config_file) +
+                               " in " + took);
+
+        if (config->log_async) {
+            cm::log_writer::options opts;
+            opts.batch_size = config->log_batch_size;
+            opts.flush_latency = std::chrono::microseconds(config->log_flush_latency.total_microseconds());
+            log->set_writer(std::make_shared<cm::log_writer>(opts));
+        }
+
         cm::application app(config, log);
 
+        cm::trace::span run("run");
         app.run();
-        return 0;
 
     } catch (const cm::config_map_exception &e) {
         std::cerr << e.what() << "\n";
-        return 1;
+        status = 1;
     } catch (const std::runtime_error &e) {
         std::cerr << "system error: " << e.what() << "\n";
-        return 2;
+        status = 2;
     }
+
+    if (!trace_file.empty() && !cm::trace::write(trace_file))
+        std::cerr << "can't write trace to " << trace_file << "\n";
+
+    return status;
 }
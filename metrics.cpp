@@ -0,0 +1,189 @@
+#include <charconv>
+#include <unistd.h>
+#include "metrics.h"
+
+namespace asio = boost::asio;
+
+namespace {
+
+    const std::chrono::seconds request_timeout(5);
+
+    template<typename Socket>
+    class session : public std::enable_shared_from_this<session<Socket>> {
+
+    public:
+        session(Socket socket, const cm::metrics_server::render_type &render)
+                : socket(std::move(socket)), strand(this->socket.get_executor()),
+                  timer(this->socket.get_executor()), request(8192), render(render) {
+        }
+
+        void start() {
+            auto self = this->shared_from_this();
+
+            timer.expires_after(request_timeout);
+            timer.async_wait(asio::bind_executor(strand, [self](const boost::system::error_code &ec) {
+                if (!ec)
+                    self->close();
+            }));
+
+            asio::async_read_until(socket, request, "\r\n\r\n", asio::bind_executor(
+                    strand, [self](const boost::system::error_code &ec, std::size_t) {
+                        if (!ec)
+                            self->respond();
+                        else
+                            self->close();
+                    }));
+        }
+
+    private:
+        void respond() {
+            std::istream is(&request);
+            std::string method, target;
+            is >> method >> target;
+
+            std::string body, status = "200 OK";
+            if (method != "GET") {
+                status = "405 Method Not Allowed";
+            } else if (target != "/metrics" && target != "/") {
+                status = "404 Not Found";
+            } else {
+                render(body);
+            }
+
+            response = "HTTP/1.1 " + status + "\r\n"
+                       "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                       "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                       "Connection: close\r\n\r\n" + body;
+
+            auto self = this->shared_from_this();
+            asio::async_write(socket, asio::buffer(response), asio::bind_executor(
+                    strand, [self](const boost::system::error_code &, std::size_t) { self->close(); }));
+        }
+
+        void close() {
+            boost::system::error_code ignored;
+            timer.cancel();
+            socket.shutdown(Socket::shutdown_both, ignored);
+            socket.close(ignored);
+        }
+
+        Socket socket;
+        asio::strand<typename Socket::executor_type> strand;
+        asio::steady_timer timer;
+        asio::streambuf request;
+        std::string response;
+        const cm::metrics_server::render_type &render;
+    };
+
+    // shortest representation which reads back as the same double, small latencies don't round to 0
+    void append_sample_value(std::string &out, double value) {
+        char buf[32];
+        auto result = std::to_chars(buf, buf + sizeof(buf), value);
+        out.append(buf, result.ptr - buf);
+    }
+
+    void append_label_value(std::string &out, std::string_view value) {
+        for (char c : value) {
+            if (c == '\\')
+                out.append("\\\\");
+            else if (c == '"')
+                out.append("\\\"");
+            else if (c == '\n')
+                out.append("\\n");
+            else
+                out.push_back(c);
+        }
+    }
+}
+
+cm::metrics_server::metrics_server(asio::io_service &ios, const std::string &listen, render_type render)
+        : ios(ios), strand(ios), render(std::move(render)) {
+
+    if (!listen.empty() && listen.front() == '/') {
+        path = std::make_unique<socket_path>(listen);
+        local = std::make_unique<asio::local::stream_protocol::acceptor>(
+                ios, asio::local::stream_protocol::endpoint(listen));
+        path->bound();
+        accept_local();
+        return;
+    }
+
+    auto colon = listen.rfind(':');
+    if (colon == std::string::npos)
+        throw boost::system::system_error(asio::error::invalid_argument, "metrics-listen " + listen);
+
+    auto host = listen.substr(0, colon);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+        host = host.substr(1, host.size() - 2);
+
+    asio::ip::tcp::endpoint endpoint;
+    try {
+        endpoint = asio::ip::tcp::endpoint(asio::ip::make_address(host.empty() ? "0.0.0.0" : host),
+                                           static_cast<unsigned short>(std::stoul(listen.substr(colon + 1))));
+    } catch (const std::logic_error &) {
+        throw boost::system::system_error(asio::error::invalid_argument, "metrics-listen " + listen);
+    }
+
+    tcp = std::make_unique<asio::ip::tcp::acceptor>(ios, endpoint);
+    accept_tcp();
+}
+
+void cm::metrics_server::stop() {
+    asio::post(strand, [this]() {
+        boost::system::error_code ignored;
+        if (tcp)
+            tcp->close(ignored);
+        if (local)
+            local->close(ignored);
+    });
+}
+
+void cm::metrics_server::accept_tcp() {
+    tcp->async_accept(asio::bind_executor(strand, [this](const boost::system::error_code &ec,
+                                                         asio::ip::tcp::socket socket) {
+        if (ec == asio::error::operation_aborted)
+            return;
+        if (!ec)
+            std::make_shared<session<asio::ip::tcp::socket>>(std::move(socket), render)->start();
+        accept_tcp();
+    }));
+}
+
+void cm::metrics_server::accept_local() {
+    local->async_accept(asio::bind_executor(strand, [this](const boost::system::error_code &ec,
+                                                           asio::local::stream_protocol::socket socket) {
+        if (ec == asio::error::operation_aborted)
+            return;
+        if (!ec)
+            std::make_shared<session<asio::local::stream_protocol::socket>>(std::move(socket), render)->start();
+        accept_local();
+    }));
+}
+
+void cm::append_metric_header(std::string &out, std::string_view name, std::string_view type, std::string_view help) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void cm::append_metric(std::string &out, std::string_view name,
+                       std::initializer_list<std::pair<std::string_view, std::string_view>> labels, double value) {
+    out.append(name);
+
+    if (labels.size() > 0) {
+        out.push_back('{');
+        bool first = true;
+        for (const auto &label : labels) {
+            if (!first)
+                out.push_back(',');
+            first = false;
+            out.append(label.first).append("=\"");
+            append_label_value(out, label.second);
+            out.push_back('"');
+        }
+        out.push_back('}');
+    }
+
+    out.push_back(' ');
+    append_sample_value(out, value);
+    out.push_back('\n');
+}
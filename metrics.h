@@ -0,0 +1,94 @@
+#ifndef CM_METRICS_H
+#define CM_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <boost/asio.hpp>
+#include "latency_histogram.h"
+#include "socket_path.h"
+
+namespace cm {
+
+    /**
+     * Counters of one output stream of an app. They are bumped with relaxed atomics on the read
+     * path and only summed up when metrics are scraped.
+     */
+    struct stream_metrics {
+        std::atomic<std::uint64_t> bytes{0}, reads{0}, lines{0}, dropped{0};
+        // steady_clock of the last read, only taken while latency is measured. lines handed out by
+        // the line buffer come from the chunk of that read or earlier ones
+        bool timed = false;
+        std::atomic<std::int64_t> read_ns{0};
+
+        void read(std::size_t n) {
+            bytes.fetch_add(n, std::memory_order_relaxed);
+            reads.fetch_add(1, std::memory_order_relaxed);
+            if (timed)
+                read_ns.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * Counters of an app over all of its restarts.
+     */
+    struct app_metrics {
+        stream_metrics out, err;
+        std::atomic<std::uint64_t> starts{0}, exits{0};
+        std::atomic<int> last_exit_code{0};
+        std::atomic_bool running{false};
+        // steady_clock of the last start
+        std::atomic<std::int64_t> started_ns{0};
+        // from the read of a line to the write of its record, if latency-interval is set
+        latency_histogram latency;
+    };
+
+    /**
+     * Serves metrics in the Prometheus text exposition format over HTTP on a TCP address (host:port)
+     * or a unix socket (a path). Every request of GET /metrics (or /) renders the metrics anew,
+     * nothing is computed between scrapes.
+     */
+    class metrics_server {
+
+    public:
+        typedef std::function<void(std::string &)> render_type;
+
+        metrics_server(const metrics_server &) = delete;
+
+        /**
+         * Throws boost::system::system_error if listen can't be bound, std::system_error if a unix
+         * socket path is taken by something else.
+         */
+        metrics_server(boost::asio::io_service &ios, const std::string &listen, render_type render);
+
+        void stop();
+
+    private:
+        void accept_tcp();
+
+        void accept_local();
+
+        boost::asio::io_service &ios;
+        boost::asio::io_service::strand strand;
+        std::unique_ptr<boost::asio::ip::tcp::acceptor> tcp;
+        std::unique_ptr<boost::asio::local::stream_protocol::acceptor> local;
+        std::unique_ptr<socket_path> path;
+        render_type render;
+    };
+
+    /**
+     * Writes the HELP and TYPE lines of a metric.
+     */
+    void append_metric_header(std::string &out, std::string_view name, std::string_view type, std::string_view help);
+
+    /**
+     * Writes one sample of a metric with labels given as name, value pairs.
+     */
+    void append_metric(std::string &out, std::string_view name,
+                       std::initializer_list<std::pair<std::string_view, std::string_view>> labels, double value);
+}
+
+#endif //CM_METRICS_H
@@ -0,0 +1,118 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "raw_stream.h"
+
+namespace {
+    const std::size_t transfer_size = 1 << 16;
+
+    int duplicate(int fd) {
+        int copy = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (copy < 0)
+            throw std::system_error(errno, std::generic_category(), "dup");
+        return copy;
+    }
+}
+
+cm::raw_stream::raw_stream(boost::asio::io_service &ios, int source_fd, int target_fd, stream_metrics &metrics)
+        : source(ios, duplicate(source_fd)), target(ios, duplicate(target_fd)), strand(ios), metrics(metrics) {
+    source.non_blocking(true);
+}
+
+void cm::raw_stream::start() {
+    wait_readable();
+}
+
+void cm::raw_stream::stop() {
+    boost::asio::post(strand, [this]() {
+        boost::system::error_code ignored;
+        stopping = true;
+        source.cancel(ignored);
+    });
+}
+
+void cm::raw_stream::wait_readable() {
+    source.async_wait(boost::asio::posix::stream_descriptor::wait_read, boost::asio::bind_executor(
+            strand, [this](const boost::system::error_code &ec) {
+                // cancelled by stop, what's left is still forwarded
+                if (ec && !stopping)
+                    done = true;
+                else
+                    transfer();
+            }));
+}
+
+void cm::raw_stream::wait_writable() {
+    target.async_wait(boost::asio::posix::stream_descriptor::wait_write, boost::asio::bind_executor(
+            strand, [this](const boost::system::error_code &ec) {
+                if (ec)
+                    done = true;
+                else
+                    transfer();
+            }));
+}
+
+void cm::raw_stream::transfer() {
+
+    while (true) {
+        ssize_t n;
+
+        if (use_splice)
+            n = ::splice(source.native_handle(), nullptr, target.native_handle(), nullptr, transfer_size,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        else
+            n = copy();
+
+        if (n > 0) {
+            metrics.read(n);
+            continue;
+        }
+
+        if (n == 0) {
+            done = true; // source closed
+            return;
+        }
+
+        if (errno == EINTR)
+            continue;
+
+        if (errno == EINVAL && use_splice) {
+            // target can't be spliced to
+            use_splice = false;
+            buffer.resize(transfer_size);
+            continue;
+        }
+
+        if (errno == EAGAIN) {
+            int available = 0;
+            if (pending_begin != pending_end || (::ioctl(source.native_handle(), FIONREAD, &available) == 0 && available > 0))
+                wait_writable();
+            else if (stopping)
+                done = true;
+            else
+                wait_readable();
+        } else {
+            done = true;
+        }
+
+        return;
+    }
+}
+
+ssize_t cm::raw_stream::copy() {
+
+    if (pending_begin == pending_end) {
+        ssize_t n = ::read(source.native_handle(), buffer.data(), buffer.size());
+        if (n <= 0)
+            return n;
+        pending_begin = 0;
+        pending_end = static_cast<std::size_t>(n);
+    }
+
+    ssize_t n = ::write(target.native_handle(), buffer.data() + pending_begin, pending_end - pending_begin);
+    if (n > 0)
+        pending_begin += static_cast<std::size_t>(n);
+
+    return n;
+}
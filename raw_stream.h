@@ -0,0 +1,60 @@
+#ifndef CM_RAW_STREAM_H
+#define CM_RAW_STREAM_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include "metrics.h"
+
+namespace cm {
+
+    /**
+     * Forwards everything readable from a pipe to a target file descriptor without looking at it.
+     * Data is moved with splice(2) so it never enters user space. Targets which don't support
+     * splice (e.g. terminals) fall back to plain read/write of whole chunks.
+     */
+    class raw_stream {
+
+    public:
+        raw_stream(const raw_stream &) = delete;
+
+        raw_stream(boost::asio::io_service &ios, int source_fd, int target_fd, stream_metrics &metrics);
+
+        /**
+         * Starts forwarding. Stops once the source is closed or can't be read anymore.
+         */
+        void start();
+
+        /**
+         * Forwards what is readable right now and stops, without waiting for the source to be closed.
+         */
+        void stop();
+
+        /**
+         * True once forwarding stopped, no handler refers to this stream anymore.
+         */
+        [[nodiscard]] bool finished() const {
+            return done.load();
+        }
+
+    private:
+        void wait_readable();
+
+        void wait_writable();
+
+        void transfer();
+
+        ssize_t copy();
+
+        boost::asio::posix::stream_descriptor source, target;
+        boost::asio::io_service::strand strand;
+        bool use_splice = true, stopping = false;
+        std::vector<char> buffer;
+        std::size_t pending_begin = 0, pending_end = 0;
+        stream_metrics &metrics;
+        std::atomic_bool done{false};
+    };
+}
+
+#endif //CM_RAW_STREAM_H
@@ -0,0 +1,128 @@
+#include <signal.h>
+#include <boost/filesystem.hpp>
+#include "readiness_probe.h"
+
+namespace asio = boost::asio;
+namespace bp = boost::process;
+
+cm::readiness_probe::readiness_probe(const config_map::configured_application &app, asio::io_service &ios,
+                                     cm::reaper &reaper, callback_type cb)
+        : app(app), ios(ios), reaper(reaper), strand(ios), timer(ios), deadline(ios), socket(ios), cb(std::move(cb)) {
+    if (app.ready == config_map::ready_probe::LOG)
+        pattern = std::regex(app.ready_target);
+}
+
+void cm::readiness_probe::start() {
+    asio::post(strand, tracked([this]() {
+        if (app.ready_timeout.total_milliseconds() > 0) {
+            deadline.expires_after(std::chrono::milliseconds(app.ready_timeout.total_milliseconds()));
+            deadline.async_wait(asio::bind_executor(strand, tracked([this](const boost::system::error_code &ec) {
+                if (!ec)
+                    finish(false);
+            })));
+        }
+
+        if (app.ready != config_map::ready_probe::LOG)
+            poll();
+    }));
+}
+
+void cm::readiness_probe::offer(std::string_view line) {
+    if (finished.load() || !std::regex_search(line.begin(), line.end(), pattern))
+        return;
+
+    asio::post(strand, tracked([this]() { finish(true); }));
+}
+
+void cm::readiness_probe::cancel() {
+    asio::post(strand, tracked([this]() {
+        finished = true;
+        timer.cancel();
+        deadline.cancel();
+        socket.close();
+        kill_command();
+    }));
+}
+
+void cm::readiness_probe::poll() {
+
+    if (finished.load())
+        return;
+
+    switch (app.ready) {
+        case config_map::ready_probe::PORT: {
+            boost::system::error_code ignored;
+            socket.close(ignored);
+            asio::ip::tcp::endpoint endpoint(asio::ip::address_v4::loopback(), app.ready_port);
+            socket.async_connect(endpoint, asio::bind_executor(strand, tracked([this](const boost::system::error_code &ec) {
+                if (ec)
+                    schedule();
+                else
+                    finish(true);
+            })));
+            break;
+        }
+        case config_map::ready_probe::FILE: {
+            boost::system::error_code ec;
+            if (boost::filesystem::exists(app.ready_target, ec))
+                finish(true);
+            else
+                schedule();
+            break;
+        }
+        case config_map::ready_probe::EXEC:
+            try {
+                auto spawning = reaper.spawning();
+                command = std::make_unique<bp::child>(
+                        ios, bp::std_in < bp::null, bp::std_out > bp::null, bp::std_err > bp::null,
+                        bp::posix::use_vfork, spawn_block::initializer(*app.ready_spawn));
+                command->detach();
+                reaper.watch(command->id(), tracked([this](int exit, const std::error_code &) {
+                    asio::post(strand, tracked([this, exit]() {
+                        command_running = false;
+                        if (exit == 0)
+                            finish(true);
+                        else
+                            schedule();
+                    }));
+                }));
+                command_running = true;
+            } catch (const bp::process_error &) {
+                schedule();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void cm::readiness_probe::schedule() {
+
+    if (finished.load())
+        return;
+
+    timer.expires_after(std::chrono::milliseconds(app.ready_interval.total_milliseconds()));
+    timer.async_wait(asio::bind_executor(strand, tracked([this](const boost::system::error_code &ec) {
+        if (!ec)
+            poll();
+    })));
+}
+
+void cm::readiness_probe::finish(bool ready) {
+
+    if (finished.exchange(true))
+        return;
+
+    timer.cancel();
+    deadline.cancel();
+    socket.close();
+    kill_command();
+
+    cb(ready);
+}
+
+void cm::readiness_probe::kill_command() {
+    // the exit is still collected by the reaper, bp::child::running() would race with it
+    if (command_running)
+        ::kill(command->id(), SIGKILL);
+}
@@ -0,0 +1,89 @@
+#ifndef CM_READINESS_PROBE_H
+#define CM_READINESS_PROBE_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <regex>
+#include <string_view>
+#include <boost/asio.hpp>
+#include <boost/process.hpp>
+#include "config_map.h"
+#include "reaper.h"
+
+namespace cm {
+
+    /**
+     * Finds out when an app is ready according to its ready-when setting: a TCP port on localhost
+     * accepting connections, a file which exists, a probe command exiting with 0, or a line of the
+     * app's output matching a pattern. Ports, files and commands are polled every ready-interval on
+     * the io_service, nothing blocks. The callback is invoked once with true when the app is ready,
+     * or with false when ready-timeout passed first.
+     */
+    class readiness_probe {
+
+    public:
+        typedef std::function<void(bool)> callback_type;
+
+        readiness_probe(const readiness_probe &) = delete;
+
+        readiness_probe(const config_map::configured_application &app, boost::asio::io_service &ios,
+                        cm::reaper &reaper, callback_type cb);
+
+        void start();
+
+        /**
+         * Checks a line of the app's output against the log pattern. Can be called from any thread.
+         */
+        void offer(std::string_view line);
+
+        /**
+         * Stops probing without invoking the callback. A running probe command is killed.
+         */
+        void cancel();
+
+        /**
+         * True once the probe finished or was cancelled and none of its handlers is in flight anymore.
+         * Only then it may be destroyed.
+         */
+        [[nodiscard]] bool idle() const {
+            return finished.load() && in_flight.load() == 0;
+        }
+
+    private:
+        /**
+         * Counts handler as in flight until it returned.
+         */
+        template<typename Handler>
+        auto tracked(Handler handler) {
+            in_flight++;
+            return [this, handler = std::move(handler)](auto &&... args) {
+                handler(std::forward<decltype(args)>(args)...);
+                in_flight--;
+            };
+        }
+
+        void poll();
+
+        void schedule();
+
+        void finish(bool ready);
+
+        void kill_command();
+
+        const config_map::configured_application &app;
+        boost::asio::io_service &ios;
+        cm::reaper &reaper;
+        boost::asio::io_service::strand strand;
+        boost::asio::steady_timer timer, deadline;
+        boost::asio::ip::tcp::socket socket;
+        std::regex pattern;
+        std::unique_ptr<boost::process::child> command;
+        bool command_running = false;
+        std::atomic_bool finished{false};
+        std::atomic_size_t in_flight{0};
+        callback_type cb;
+    };
+}
+
+#endif //CM_READINESS_PROBE_H
@@ -0,0 +1,195 @@
+#include <csignal>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "reaper.h"
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+namespace {
+
+    // same as boost.process: the exit status, or the number of the signal which killed the process
+    int exit_code_of(int status) {
+        if (WIFEXITED(status))
+            return WEXITSTATUS(status);
+        if (WIFSIGNALED(status))
+            return WTERMSIG(status);
+        return status;
+    }
+
+    int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+        return static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+#else
+        errno = ENOSYS;
+        return -1;
+#endif
+    }
+
+    // pidfd_open came with Linux 5.3, waitid(P_PIDFD) only with 5.4. cm isn't its own child, a
+    // kernel knowing P_PIDFD answers ECHILD for it, an older one EINVAL
+    bool pidfd_supported() {
+        int fd = open_pidfd(::getpid());
+        if (fd == -1)
+            return false;
+
+        siginfo_t info{};
+        bool supported = ::waitid(static_cast<idtype_t>(P_PIDFD), fd, &info, WEXITED | WNOHANG) == -1 &&
+                         errno == ECHILD;
+        ::close(fd);
+        return supported;
+    }
+}
+
+cm::reaper::reaper(boost::asio::io_service &ios, bool reap_orphans)
+        : ios(ios), pidfds(pidfd_supported()), orphans(reap_orphans), strand(ios), signals(ios) {
+
+    if (orphans || !pidfds)
+        start_signals();
+}
+
+void cm::reaper::block_sigchld() {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    ::pthread_sigmask(SIG_BLOCK, &set, nullptr);
+}
+
+std::shared_lock<std::shared_mutex> cm::reaper::spawning() {
+    return std::shared_lock<std::shared_mutex>(spawn_mutex);
+}
+
+void cm::reaper::watch(pid_t pid, exit_callback_type cb) {
+
+    auto w = std::make_shared<watched>(ios, pid, std::move(cb));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    children[pid] = w;
+
+    if (!pidfds)
+        return;
+
+    int fd = open_pidfd(pid);
+    if (fd == -1) {
+        // out of descriptors, the signalfd loop reaps this child instead
+        start_signals();
+        return;
+    }
+
+    w->pidfd.assign(fd);
+    wait_exit(w);
+}
+
+void cm::reaper::stop() {
+    boost::asio::post(strand, [this]() {
+        stopped = true;
+        boost::system::error_code ignored;
+        signals.close(ignored);
+    });
+}
+
+void cm::reaper::wait_exit(const std::shared_ptr<watched> &w) {
+    w->pidfd.async_wait(boost::asio::posix::descriptor_base::wait_read,
+                        [this, w](const boost::system::error_code &ec) { exit_handler(w, ec); });
+}
+
+void cm::reaper::exit_handler(const std::shared_ptr<watched> &w, const boost::system::error_code &ec) {
+
+    // closed by the signalfd loop, which reaped the process and invoked the callback
+    if (ec)
+        return;
+
+    siginfo_t info{};
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (w->gone)
+            return;
+
+        // ECHILD: the signalfd loop was faster and invokes the callback once it got the lock
+        if (::waitid(static_cast<idtype_t>(P_PIDFD), w->pidfd.native_handle(), &info, WEXITED | WNOHANG) == -1)
+            return;
+
+        if (info.si_pid == 0) {
+            wait_exit(w);
+            return;
+        }
+
+        // the pid can only be reused once it was reaped, no other child is registered under it yet
+        children.erase(w->pid);
+        w->gone = true;
+        boost::system::error_code ignored;
+        w->pidfd.close(ignored);
+    }
+
+    // si_status is the exit status or the signal, like exit_code_of
+    w->cb(info.si_status, {});
+}
+
+void cm::reaper::start_signals() {
+    boost::asio::post(strand, [this]() {
+        if (stopped || signals.is_open())
+            return;
+
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGCHLD);
+        int fd = ::signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (fd == -1)
+            throw std::system_error(errno, std::system_category(), "signalfd failed");
+
+        signals.assign(fd);
+        // exits before the signalfd existed left SIGCHLD pending, which the signalfd reports as
+        // well. zombies of children which exited before the pending one don't, so reap right away
+        reap();
+        wait_signal();
+    });
+}
+
+void cm::reaper::wait_signal() {
+    signals.async_wait(boost::asio::posix::descriptor_base::wait_read, boost::asio::bind_executor(
+            strand, [this](const boost::system::error_code &ec) {
+                if (ec || stopped)
+                    return;
+
+                // SIGCHLD isn't queued, one pending signal may stand for any number of exits
+                signalfd_siginfo infos[16];
+                while (::read(signals.native_handle(), infos, sizeof(infos)) > 0) {
+                }
+
+                reap();
+                wait_signal();
+            }));
+}
+
+void cm::reaper::reap() {
+
+    std::vector<std::pair<std::shared_ptr<watched>, int>> exited;
+    {
+        // no child is between fork and watch, every pid not in children is an orphan
+        std::unique_lock<std::shared_mutex> spawn_lock(spawn_mutex);
+
+        int status;
+        pid_t pid;
+        while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = children.find(pid);
+            if (it == children.end()) {
+                reaped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            auto w = std::move(it->second);
+            children.erase(it);
+            w->gone = true;
+            boost::system::error_code ignored;
+            w->pidfd.close(ignored);
+            exited.emplace_back(std::move(w), status);
+        }
+    }
+
+    for (auto &e : exited)
+        e.first->cb(exit_code_of(e.second), {});
+}
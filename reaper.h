@@ -0,0 +1,110 @@
+#ifndef CM_REAPER_H
+#define CM_REAPER_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include <boost/asio.hpp>
+
+namespace cm {
+
+    /**
+     * Collects the exit of every process started by cm. Each child is watched through a pidfd on
+     * the io_service and reaped with waitid(P_PIDFD), so an exit costs one wakeup no matter how many
+     * children run, unlike a waitpid per child on every SIGCHLD.
+     *
+     * With reap_orphans cm also reaps processes it adopted, as PID 1 or child subreaper: SIGCHLD is
+     * read from a signalfd and zombies are collected with waitpid(-1). A child of cm reaped by that
+     * loop is handed to its callback as well, the callback of a child is invoked exactly once either
+     * way. Without pidfds (Linux < 5.4) all children go through the signalfd loop.
+     *
+     * SIGCHLD has to be blocked in every thread of cm before the reaper is created, see block_sigchld.
+     */
+    class reaper {
+
+    public:
+        typedef std::function<void(const int, const std::error_code &)> exit_callback_type;
+
+        reaper(const reaper &) = delete;
+
+        reaper(boost::asio::io_service &ios, bool reap_orphans);
+
+        /**
+         * Blocks SIGCHLD in the calling thread, threads started afterwards inherit the mask.
+         */
+        static void block_sigchld();
+
+        /**
+         * Held while a child is started until it is watched. Orphans aren't reaped in between, the
+         * new child might be taken for one.
+         */
+        [[nodiscard]] std::shared_lock<std::shared_mutex> spawning();
+
+        /**
+         * Invokes cb with the exit code, or the signal which killed the process, once pid exited.
+         * Must be called while spawning() is held.
+         */
+        void watch(pid_t pid, exit_callback_type cb);
+
+        /**
+         * Stops reaping orphans, so the io_service can run out of work.
+         */
+        void stop();
+
+        [[nodiscard]] bool using_pidfd() const {
+            return pidfds;
+        }
+
+        [[nodiscard]] bool reaping_orphans() const {
+            return orphans;
+        }
+
+        [[nodiscard]] std::uint64_t orphans_reaped() const {
+            return reaped.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct watched {
+            pid_t pid;
+            boost::asio::posix::stream_descriptor pidfd;
+            exit_callback_type cb;
+            // reaped by the signalfd loop, the pidfd may already be closed
+            bool gone = false;
+
+            watched(boost::asio::io_service &ios, pid_t pid, exit_callback_type cb)
+                    : pid(pid), pidfd(ios), cb(std::move(cb)) {
+            }
+        };
+
+        void wait_exit(const std::shared_ptr<watched> &w);
+
+        void exit_handler(const std::shared_ptr<watched> &w, const boost::system::error_code &ec);
+
+        void start_signals();
+
+        void wait_signal();
+
+        void reap();
+
+        boost::asio::io_service &ios;
+        bool pidfds = false;
+        bool orphans = false;
+        // serializes the handlers of the signalfd
+        boost::asio::io_service::strand strand;
+        boost::asio::posix::stream_descriptor signals;
+        bool stopped = false;
+        // guards children and every operation on their pidfds
+        std::mutex mutex;
+        std::unordered_map<pid_t, std::shared_ptr<watched>> children;
+        std::shared_mutex spawn_mutex;
+        std::atomic<std::uint64_t> reaped{0};
+    };
+}
+
+#endif //CM_REAPER_H
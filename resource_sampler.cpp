@@ -0,0 +1,195 @@
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "resource_sampler.h"
+
+namespace {
+
+    int open_proc(int pid, const char *file) {
+        char path[64];
+        std::snprintf(path, sizeof(path), "/proc/%d/%s", pid, file);
+        return ::open(path, O_RDONLY | O_CLOEXEC);
+    }
+
+    // reads the whole file into buf and terminates it, false if the process is gone
+    bool read_proc(int fd, char *buf, std::size_t size, std::size_t &len) {
+        if (fd < 0)
+            return false;
+
+        ssize_t n = ::pread(fd, buf, size - 1, 0);
+        if (n < 0)
+            return false;
+
+        len = static_cast<std::size_t>(n);
+        buf[len] = '\0';
+        return true;
+    }
+
+    const char *skip_fields(const char *p, int fields) {
+        while (fields-- > 0) {
+            while (*p == ' ')
+                p++;
+            while (*p && *p != ' ')
+                p++;
+        }
+        return p;
+    }
+
+    std::uint64_t parse_number(const char *&p) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+
+        std::uint64_t v = 0;
+        for (; *p >= '0' && *p <= '9'; p++)
+            v = v * 10 + static_cast<std::uint64_t>(*p - '0');
+        return v;
+    }
+
+    // value of a "key: number" line, key including the leading newline to match whole keys only
+    std::uint64_t find_value(const char *buf, std::size_t len, const char *key) {
+        const char *p = static_cast<const char *>(::memmem(buf, len, key, std::strlen(key)));
+        if (!p)
+            return 0;
+        p += std::strlen(key);
+        return parse_number(p);
+    }
+}
+
+cm::resource_sampler::resource_sampler(boost::asio::io_service &ios, std::chrono::milliseconds interval)
+        : strand(ios), timer(ios), interval(interval), ticks_per_second(::sysconf(_SC_CLK_TCK)),
+          page_size(::sysconf(_SC_PAGESIZE)) {
+}
+
+cm::resource_sampler::~resource_sampler() {
+    for (auto &p : processes)
+        close(p);
+}
+
+void cm::resource_sampler::add(const std::string &app, int pid) {
+
+    process p;
+    p.last.app = app;
+    p.last.pid = pid;
+    p.stat = open_proc(pid, "stat");
+    p.statm = open_proc(pid, "statm");
+    p.io = open_proc(pid, "io");
+    p.status = open_proc(pid, "status");
+    p.sampled = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    processes.push_back(std::move(p));
+}
+
+void cm::resource_sampler::add_listener(listener_type listener) {
+    std::lock_guard<std::mutex> lock(mutex);
+    listeners.push_back(std::move(listener));
+}
+
+std::vector<cm::resource_sampler::usage> cm::resource_sampler::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return samples;
+}
+
+void cm::resource_sampler::start() {
+    timer.expires_after(interval);
+    timer.async_wait(boost::asio::bind_executor(strand, [this](const boost::system::error_code &ec) {
+        if (!ec)
+            sample();
+    }));
+}
+
+void cm::resource_sampler::stop() {
+    boost::asio::post(strand, [this]() { timer.cancel(); });
+}
+
+void cm::resource_sampler::sample() {
+
+    auto now = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // assigning to the existing elements keeps the capacity of their strings
+        std::size_t n = 0;
+
+        for (auto it = processes.begin(); it != processes.end();) {
+            if (sample(*it, now)) {
+                if (n < samples.size())
+                    samples[n] = it->last;
+                else
+                    samples.push_back(it->last);
+                n++;
+                it++;
+            } else {
+                close(*it);
+                it = processes.erase(it);
+            }
+        }
+
+        samples.resize(n);
+    }
+
+    // listeners are only added before start, samples is only written on this strand
+    for (const auto &listener : listeners)
+        listener(samples);
+
+    // fixed rate instead of fixed delay, a slow round doesn't shift the following ones
+    timer.expires_at(timer.expiry() + interval);
+    if (timer.expiry() < now)
+        timer.expires_after(interval);
+    timer.async_wait(boost::asio::bind_executor(strand, [this](const boost::system::error_code &ec) {
+        if (!ec)
+            sample();
+    }));
+}
+
+bool cm::resource_sampler::sample(process &p, std::chrono::steady_clock::time_point now) {
+
+    std::size_t len = 0;
+
+    if (!read_proc(p.stat, buffer, sizeof(buffer), len))
+        return false;
+
+    // comm may contain spaces and parentheses, the fields start after the last ')'
+    const char *fields = static_cast<const char *>(::memrchr(buffer, ')', len));
+    if (!fields)
+        return false;
+
+    // state is field 3, utime and stime are fields 14 and 15
+    const char *f = skip_fields(fields + 1, 11);
+    std::uint64_t ticks = parse_number(f);
+    ticks += parse_number(f);
+
+    std::chrono::duration<double> elapsed = now - p.sampled;
+    if (elapsed.count() > 0 && ticks >= p.cpu_ticks)
+        p.last.cpu_percent = 100.0 * static_cast<double>(ticks - p.cpu_ticks) /
+                             static_cast<double>(ticks_per_second) / elapsed.count();
+    p.cpu_ticks = ticks;
+    p.sampled = now;
+
+    if (read_proc(p.statm, buffer, sizeof(buffer), len)) {
+        const char *m = skip_fields(buffer, 1);
+        p.last.rss_bytes = parse_number(m) * static_cast<std::uint64_t>(page_size);
+    }
+
+    // /proc/<pid>/io is missing without task io accounting
+    if (read_proc(p.io, buffer + 1, sizeof(buffer) - 1, len)) {
+        buffer[0] = '\n';
+        p.last.read_bytes = find_value(buffer, len + 1, "\nread_bytes:");
+        p.last.write_bytes = find_value(buffer, len + 1, "\nwrite_bytes:");
+    }
+
+    if (read_proc(p.status, buffer, sizeof(buffer), len)) {
+        p.last.voluntary_switches = find_value(buffer, len, "\nvoluntary_ctxt_switches:");
+        p.last.involuntary_switches = find_value(buffer, len, "\nnonvoluntary_ctxt_switches:");
+    }
+
+    return true;
+}
+
+void cm::resource_sampler::close(process &p) {
+    for (int fd : {p.stat, p.statm, p.io, p.status})
+        if (fd >= 0)
+            ::close(fd);
+    p.stat = p.statm = p.io = p.status = -1;
+}
@@ -0,0 +1,87 @@
+#ifndef CM_RESOURCE_SAMPLER_H
+#define CM_RESOURCE_SAMPLER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+
+namespace cm {
+
+    /**
+     * Samples CPU, memory, I/O and context switches of the children from /proc at a fixed interval.
+     * The /proc files of a process are opened once and reread with pread into a fixed buffer, so a
+     * sample neither allocates nor walks /proc. Processes which exited are dropped on their next
+     * sample, their files fail with ESRCH then even if the pid got reused.
+     */
+    class resource_sampler {
+
+    public:
+        struct usage {
+            std::string app;
+            int pid = 0;
+            // of one cpu since the last sample, may exceed 100 for multithreaded apps
+            double cpu_percent = 0;
+            std::uint64_t rss_bytes = 0;
+            std::uint64_t read_bytes = 0, write_bytes = 0;
+            std::uint64_t voluntary_switches = 0, involuntary_switches = 0;
+        };
+
+        typedef std::function<void(const std::vector<usage> &)> listener_type;
+
+        resource_sampler(const resource_sampler &) = delete;
+
+        resource_sampler(boost::asio::io_service &ios, std::chrono::milliseconds interval);
+
+        ~resource_sampler();
+
+        /**
+         * Samples the process from now on. Can be called from any thread.
+         */
+        void add(const std::string &app, int pid);
+
+        /**
+         * Listeners are called on the sampler's strand with all samples of one round.
+         */
+        void add_listener(listener_type listener);
+
+        /**
+         * Returns the samples of the last round.
+         */
+        std::vector<usage> snapshot() const;
+
+        void start();
+
+        void stop();
+
+    private:
+        struct process {
+            usage last;
+            int stat = -1, statm = -1, io = -1, status = -1;
+            std::uint64_t cpu_ticks = 0;
+            std::chrono::steady_clock::time_point sampled;
+        };
+
+        void sample();
+
+        bool sample(process &p, std::chrono::steady_clock::time_point now);
+
+        static void close(process &p);
+
+        boost::asio::io_service::strand strand;
+        boost::asio::steady_timer timer;
+        const std::chrono::milliseconds interval;
+        const long ticks_per_second, page_size;
+
+        mutable std::mutex mutex;
+        std::vector<process> processes;
+        std::vector<usage> samples;
+        std::vector<listener_type> listeners;
+        char buffer[4096];
+    };
+}
+
+#endif //CM_RESOURCE_SAMPLER_H
@@ -0,0 +1,43 @@
+#include "restart_policy.h"
+
+namespace {
+    std::chrono::milliseconds to_chrono(const boost::posix_time::time_duration &d) {
+        return std::chrono::milliseconds(d.total_milliseconds());
+    }
+}
+
+cm::restart_policy::restart_policy(const config_map::configured_application &app)
+        : mode(app.restart), initial_delay(to_chrono(app.restart_delay)), max_delay(to_chrono(app.restart_max_delay)),
+          window(to_chrono(app.restart_window)), limit(app.restart_limit), delay(initial_delay),
+          random(std::random_device()()) {
+}
+
+void cm::restart_policy::started(clock::time_point now) {
+    last_start = now;
+}
+
+cm::restart_policy::decision cm::restart_policy::exited(int exit_code, clock::time_point now) {
+
+    if (mode == config_map::restart_mode::NEVER || (mode == config_map::restart_mode::ON_FAILURE && exit_code == 0))
+        return {action::STOP, std::chrono::milliseconds(0)};
+
+    // a run over a whole window isn't part of a crash loop anymore
+    if (now - last_start >= window)
+        delay = initial_delay;
+
+    while (!restarts.empty() && now - restarts.front() >= window)
+        restarts.pop_front();
+
+    if (limit > 0 && restarts.size() >= limit)
+        return {action::CRASH_LOOP, std::chrono::milliseconds(0)};
+
+    restarts.push_back(now);
+
+    auto half = delay.count() / 2;
+    std::uniform_int_distribution<long long> jitter(0, delay.count() - half);
+    std::chrono::milliseconds next(half + jitter(random));
+
+    delay = std::min(max_delay, delay * 2);
+
+    return {action::RESTART, next};
+}
@@ -0,0 +1,57 @@
+#ifndef CM_RESTART_POLICY_H
+#define CM_RESTART_POLICY_H
+
+#include <chrono>
+#include <deque>
+#include <random>
+#include "config_map.h"
+
+namespace cm {
+
+    /**
+     * Decides whether an exited app is restarted and when. The delay doubles with every restart up to
+     * max_delay and is jittered into [delay / 2, delay], so replicas crashing together don't restart in
+     * lockstep. It falls back to the initial delay once an app ran for a whole window. More than limit
+     * restarts within one window are a crash loop.
+     */
+    class restart_policy {
+
+    public:
+        typedef std::chrono::steady_clock clock;
+
+        enum class action {
+            STOP, RESTART, CRASH_LOOP
+        };
+
+        struct decision {
+            action what;
+            std::chrono::milliseconds delay;
+        };
+
+        explicit restart_policy(const config_map::configured_application &app);
+
+        void started(clock::time_point now);
+
+        decision exited(int exit_code, clock::time_point now);
+
+        /**
+         * Returns the number of restarts within the current window.
+         */
+        [[nodiscard]] std::size_t recent_restarts() const {
+            return restarts.size();
+        }
+
+    private:
+        // not const, a reload assigns the policy of the changed app
+        config_map::restart_mode mode;
+        std::chrono::milliseconds initial_delay, max_delay, window;
+        unsigned limit;
+
+        std::chrono::milliseconds delay;
+        clock::time_point last_start;
+        std::deque<clock::time_point> restarts;
+        std::minstd_rand random;
+    };
+}
+
+#endif //CM_RESTART_POLICY_H
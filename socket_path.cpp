@@ -0,0 +1,55 @@
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "socket_path.h"
+
+cm::socket_path::socket_path(std::string path)
+        : file(std::move(path)) {
+
+    struct stat st{};
+    if (::lstat(file.c_str(), &st) == -1) {
+        if (errno == ENOENT)
+            return;
+        throw std::system_error(errno, std::generic_category(), "lstat " + file);
+    }
+
+    if (!S_ISSOCK(st.st_mode))
+        throw std::system_error(EEXIST, std::generic_category(), file + " exists and isn't a socket");
+
+    // left behind by a process which is gone, unless someone still accepts on it
+    sockaddr_un sun{};
+    if (file.size() >= sizeof(sun.sun_path))
+        throw std::system_error(ENAMETOOLONG, std::generic_category(), file);
+    sun.sun_family = AF_UNIX;
+    std::memcpy(sun.sun_path, file.c_str(), file.size() + 1);
+
+    int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe == -1)
+        throw std::system_error(errno, std::generic_category(), "socket " + file);
+    bool live = ::connect(probe, reinterpret_cast<const sockaddr *>(&sun), sizeof(sun)) == 0;
+    ::close(probe);
+    if (live)
+        throw std::system_error(EADDRINUSE, std::generic_category(), file + " is in use by another process");
+
+    if (::unlink(file.c_str()) == -1 && errno != ENOENT)
+        throw std::system_error(errno, std::generic_category(), "unlink " + file);
+}
+
+cm::socket_path::~socket_path() {
+    struct stat st{};
+    if (owned && ::lstat(file.c_str(), &st) == 0 && S_ISSOCK(st.st_mode) && st.st_dev == dev && st.st_ino == ino)
+        ::unlink(file.c_str());
+}
+
+void cm::socket_path::bound() {
+    struct stat st{};
+    if (::lstat(file.c_str(), &st) == -1)
+        throw std::system_error(errno, std::generic_category(), "lstat " + file);
+    dev = st.st_dev;
+    ino = st.st_ino;
+    owned = true;
+}
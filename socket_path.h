@@ -0,0 +1,47 @@
+#ifndef CM_SOCKET_PATH_H
+#define CM_SOCKET_PATH_H
+
+#include <string>
+#include <sys/types.h>
+
+namespace cm {
+
+    /**
+     * The path of a unix socket cm listens on. Only a socket left behind by a process which is gone is
+     * replaced, and on exit the path is removed only while it is still the socket cm bound. A typo in a
+     * path must not delete a file, cm often runs as root.
+     */
+    class socket_path {
+
+    public:
+        socket_path(const socket_path &) = delete;
+
+        /**
+         * Removes a stale socket at path. Throws std::system_error if path is something else or another
+         * process still accepts connections on it.
+         */
+        explicit socket_path(std::string path);
+
+        /**
+         * Removes the path if it is still the socket remembered by bound().
+         */
+        ~socket_path();
+
+        /**
+         * Remembers the socket just bound at the path. Throws std::system_error.
+         */
+        void bound();
+
+        [[nodiscard]] const std::string &path() const {
+            return file;
+        }
+
+    private:
+        std::string file;
+        bool owned = false;
+        dev_t dev = 0;
+        ino_t ino = 0;
+    };
+}
+
+#endif //CM_SOCKET_PATH_H
@@ -0,0 +1,122 @@
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "spawn_block.h"
+
+cm::spawn_block::spawn_block(std::string executable, const std::vector<std::string> &args,
+                             const std::vector<std::string> &environment, std::string directory,
+                             const scheduling &sched)
+        : exe(std::move(executable)), dir(std::move(directory)), sched(sched) {
+
+    // the cpu_set_t is built up front, the vforked child must not allocate
+    CPU_ZERO(&affinity);
+    for (int cpu : sched.cpus) {
+        CPU_SET(cpu, &affinity);
+        has_affinity = true;
+    }
+
+    strings.reserve(1 + args.size() + environment.size());
+    strings.push_back(exe);
+    strings.insert(strings.end(), args.begin(), args.end());
+    strings.insert(strings.end(), environment.begin(), environment.end());
+
+    // strings doesn't grow anymore, the pointers stay valid
+    std::size_t i = 0;
+    for (; i < 1 + args.size(); i++)
+        argv.push_back(strings[i].data());
+    argv.push_back(nullptr);
+
+    for (; i < strings.size(); i++)
+        envp.push_back(strings[i].data());
+    envp.push_back(nullptr);
+}
+
+bool cm::spawn_block::operator==(const spawn_block &other) const {
+    return exe == other.exe && dir == other.dir && sched == other.sched && argv.size() == other.argv.size() &&
+           strings == other.strings;
+}
+
+const char *cm::spawn_block::apply_scheduling() const {
+
+    if (has_affinity && ::sched_setaffinity(0, sizeof(affinity), &affinity) == -1)
+        return "sched_setaffinity failed";
+
+    if (sched.policy) {
+        sched_param param{};
+        param.sched_priority = sched.priority;
+        if (::sched_setscheduler(0, *sched.policy, &param) == -1)
+            return "sched_setscheduler failed";
+    }
+
+    if (sched.nice && ::setpriority(PRIO_PROCESS, 0, *sched.nice) == -1)
+        return "setpriority failed";
+
+    // glibc has no wrapper for ioprio_set. IOPRIO_WHO_PROCESS is 1, the class takes the top 3 bits
+    if (sched.io_class && ::syscall(SYS_ioprio_set, 1, 0, (*sched.io_class << 13) | sched.io_level) == -1)
+        return "ioprio_set failed";
+
+    return nullptr;
+}
+
+cm::spawn_block::listen_fds::listen_fds(const spawn_block &block, std::vector<int> fds)
+        : fds(std::move(fds)), count("LISTEN_FDS=" + std::to_string(this->fds.size())), moved(this->fds.size()) {
+
+    // whatever cm itself may have been passed doesn't describe the app's fds
+    for (char *entry : block.envp) {
+        if (entry && std::strncmp(entry, "LISTEN_FDS=", 11) != 0 && std::strncmp(entry, "LISTEN_PID=", 11) != 0 &&
+            std::strncmp(entry, "LISTEN_FDNAMES=", 15) != 0)
+            envp.push_back(entry);
+    }
+    envp.push_back(count.data());
+    envp.push_back(pid);
+    envp.push_back(nullptr);
+}
+
+const char *cm::spawn_block::listen_fds::apply() const {
+    const int first = 3, n = static_cast<int>(fds.size());
+
+    // out of the way first, a socket may already sit on one of the target numbers. the copies are
+    // above the passed range and closed with the other inherited fds
+    for (int i = 0; i < n; i++) {
+        moved[i] = ::fcntl(fds[i], F_DUPFD_CLOEXEC, first + n);
+        if (moved[i] == -1)
+            return "fcntl failed";
+    }
+    // dup2 clears close-on-exec of the new fd
+    for (int i = 0; i < n; i++) {
+        if (::dup2(moved[i], first + i) == -1)
+            return "dup2 failed";
+    }
+
+    char digits[16];
+    int len = 0;
+    for (pid_t p = ::getpid(); p > 0; p /= 10)
+        digits[len++] = static_cast<char>('0' + p % 10);
+    char *out = pid + std::strlen("LISTEN_PID=");
+    while (len > 0)
+        *out++ = digits[--len];
+    *out = '\0';
+
+    return nullptr;
+}
+
+void cm::spawn_block::unblock_sigchld() {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    ::sigprocmask(SIG_UNBLOCK, &set, nullptr);
+}
+
+void cm::spawn_block::close_inherited_fds(int first) {
+#ifdef SYS_close_range
+    if (::syscall(SYS_close_range, static_cast<unsigned>(first), ~0U, 0U) == 0)
+        return;
+#endif
+    long max = ::sysconf(_SC_OPEN_MAX);
+    if (max < 0 || max > 65536)
+        max = 65536;
+    for (int fd = first; fd < max; fd++)
+        ::close(fd);
+}
@@ -0,0 +1,157 @@
+#ifndef CM_SPAWN_BLOCK_H
+#define CM_SPAWN_BLOCK_H
+
+#include <optional>
+#include <string>
+#include <vector>
+#include <sched.h>
+#include <unistd.h>
+#include <boost/process.hpp>
+#include <boost/process/extend.hpp>
+
+namespace cm {
+
+    /**
+     * Everything execve needs to start an app: resolved executable, argv, the merged environment
+     * and the working directory. Built once when the configuration is loaded, so starting an app
+     * doesn't copy or search anything.
+     */
+    class spawn_block {
+
+    public:
+        /**
+         * CPU and I/O scheduling applied to the child before exec. Unset values are inherited from cm.
+         */
+        struct scheduling {
+            std::vector<int> cpus;
+            std::optional<int> nice;
+            std::optional<int> policy;
+            int priority = 0;
+            // IOPRIO_CLASS_RT, _BE or _IDLE and the level within the class
+            std::optional<int> io_class;
+            int io_level = 0;
+
+            bool operator==(const scheduling &other) const {
+                return cpus == other.cpus && nice == other.nice && policy == other.policy &&
+                       priority == other.priority && io_class == other.io_class && io_level == other.io_level;
+            }
+        };
+
+        spawn_block(const spawn_block &) = delete;
+
+        spawn_block(std::string executable, const std::vector<std::string> &args,
+                    const std::vector<std::string> &environment, std::string directory,
+                    const scheduling &sched);
+
+        [[nodiscard]] const std::string &executable() const {
+            return exe;
+        }
+
+        [[nodiscard]] const std::string &directory() const {
+            return dir;
+        }
+
+        /**
+         * Same executable, argv, environment, directory and scheduling.
+         */
+        bool operator==(const spawn_block &other) const;
+
+        struct initializer;
+
+        /**
+         * Listening sockets passed to one start of an app as fd 3 and up, announced in LISTEN_FDS and
+         * LISTEN_PID like systemd's socket activation does. Built before the fork with the block's
+         * environment, the vforked child only moves the fds and writes its pid into the prepared entry.
+         */
+        class listen_fds {
+
+        public:
+            listen_fds(const listen_fds &) = delete;
+
+            listen_fds(const spawn_block &block, std::vector<int> fds);
+
+            [[nodiscard]] std::size_t size() const {
+                return fds.size();
+            }
+
+        private:
+            friend struct initializer;
+
+            /**
+             * Runs in the vforked child. Returns the name of the failed call, nullptr on success.
+             */
+            const char *apply() const;
+
+            std::vector<int> fds;
+            std::string count;
+            std::vector<char *> envp;
+            // written by the vforked child, it shares the memory of cm until exec
+            mutable std::vector<int> moved;
+            mutable char pid[32] = "LISTEN_PID=";
+        };
+
+        /**
+         * boost.process initializer passing the prebuilt blocks to the executor.
+         */
+        struct initializer : boost::process::extend::handler {
+            const spawn_block &block;
+            const listen_fds *sockets;
+
+            explicit initializer(const spawn_block &block, const listen_fds *sockets = nullptr)
+                    : block(block), sockets(sockets) {
+            }
+
+            template<typename Executor>
+            void on_setup(Executor &exec) const {
+                exec.exe = block.exe.c_str();
+                exec.cmd_line = block.argv.data();
+                exec.env = const_cast<char **>(sockets ? sockets->envp.data() : block.envp.data());
+            }
+
+            // runs in the vforked child after the pipes are dup'ed, only async-signal-safe calls here
+            template<typename Executor>
+            void on_exec_setup(Executor &exec) const {
+                if (::chdir(block.dir.c_str()) == -1) {
+                    exec.set_error(boost::process::detail::get_last_error(), "chdir failed");
+                    ::_exit(EXIT_FAILURE);
+                }
+                if (const char *failed = block.apply_scheduling()) {
+                    exec.set_error(boost::process::detail::get_last_error(), failed);
+                    ::_exit(EXIT_FAILURE);
+                }
+                if (const char *failed = sockets ? sockets->apply() : nullptr) {
+                    exec.set_error(boost::process::detail::get_last_error(), failed);
+                    ::_exit(EXIT_FAILURE);
+                }
+                unblock_sigchld();
+                close_inherited_fds(sockets ? 3 + static_cast<int>(sockets->size()) : 3);
+            }
+        };
+
+    private:
+        /**
+         * Children spawned in parallel would otherwise inherit each other's pipe ends and never see EOF.
+         * Closes everything from first on, below are stdio and the passed sockets.
+         */
+        static void close_inherited_fds(int first);
+
+        /**
+         * cm blocks SIGCHLD for its signalfd. The mask survives exec, apps waiting for SIGCHLD would never get it.
+         */
+        static void unblock_sigchld();
+
+        /**
+         * Returns the name of the failed call, nullptr on success. errno is set by the call.
+         */
+        const char *apply_scheduling() const;
+
+        std::string exe, dir;
+        bool has_affinity = false;
+        cpu_set_t affinity{};
+        scheduling sched;
+        std::vector<std::string> strings;
+        std::vector<char *> argv, envp;
+    };
+}
+
+#endif //CM_SPAWN_BLOCK_H
@@ -0,0 +1,120 @@
+#include "timing_wheel.h"
+
+cm::timing_wheel::timing_wheel(boost::asio::io_service::strand &strand, clock::duration tick)
+        : strand(strand), timer(strand.context()), tick(tick), origin(clock::now()) {
+}
+
+cm::timing_wheel::handle cm::timing_wheel::schedule(clock::duration delay, callback_type cb) {
+
+    // an idle wheel skips the ticks it slept through, there is nothing in the slots
+    if (!ticking)
+        now_tick = elapsed_ticks();
+
+    auto ticks = std::max<clock::duration::rep>(1, (delay.count() + tick.count() - 1) / tick.count());
+
+    auto e = std::make_shared<entry>();
+    e->expires = now_tick + static_cast<std::uint64_t>(ticks);
+    e->cb = std::move(cb);
+    insert(e);
+    pending++;
+
+    if (!ticking)
+        start_ticking();
+    return e;
+}
+
+void cm::timing_wheel::cancel(const handle &h) {
+    if (!h || h->done)
+        return;
+
+    h->done = true;
+    h->cb = nullptr;
+    pending--;
+}
+
+void cm::timing_wheel::stop() {
+    for (auto &level : wheel)
+        for (auto &slot : level)
+            for (auto &e : slot)
+                cancel(e);
+
+    timer.cancel();
+    ticking = false;
+}
+
+void cm::timing_wheel::insert(const handle &e) {
+    auto diff = e->expires > now_tick ? e->expires - now_tick : 0;
+
+    for (int level = 0; level < levels; level++) {
+        if (diff >> (slot_bits * (level + 1)) == 0) {
+            wheel[level][(e->expires >> (slot_bits * level)) & slot_mask].push_back(e);
+            return;
+        }
+    }
+
+    // beyond the last level: the slot furthest away, from there it is inserted again
+    const int top = slot_bits * (levels - 1);
+    wheel[levels - 1][((now_tick >> top) + slot_mask) & slot_mask].push_back(e);
+}
+
+void cm::timing_wheel::advance() {
+    now_tick++;
+
+    // when a level completed a turn, the next slot of the level above is spread over the levels below
+    for (int level = 1; level < levels; level++) {
+        if ((now_tick & ((std::uint64_t(1) << (slot_bits * level)) - 1)) != 0)
+            break;
+
+        auto &slot = wheel[level][(now_tick >> (slot_bits * level)) & slot_mask];
+        auto moving = std::move(slot);
+        slot.clear();
+        for (auto &e : moving)
+            if (!e->done)
+                insert(e);
+    }
+
+    auto &slot = wheel[0][now_tick & slot_mask];
+    auto due = std::move(slot);
+    slot.clear();
+
+    for (auto &e : due) {
+        if (e->done)
+            continue;
+        e->done = true;
+        pending--;
+        auto cb = std::move(e->cb);
+        cb();
+    }
+}
+
+void cm::timing_wheel::start_ticking() {
+    ticking = true;
+    timer.expires_at(origin + tick * static_cast<clock::duration::rep>(now_tick + 1));
+    timer.async_wait(boost::asio::bind_executor(strand, [this](const boost::system::error_code &ec) {
+        tick_handler(ec);
+    }));
+}
+
+void cm::timing_wheel::tick_handler(const boost::system::error_code &ec) {
+    if (ec || !ticking)
+        return;
+
+    // a late timer catches up with every tick it missed
+    auto target = elapsed_ticks();
+    while (now_tick < target && pending > 0)
+        advance();
+
+    if (pending == 0) {
+        ticking = false;
+        for (auto &level : wheel)
+            for (auto &slot : level)
+                slot.clear();
+        return;
+    }
+
+    start_ticking();
+}
+
+std::uint64_t cm::timing_wheel::elapsed_ticks() const {
+    return static_cast<std::uint64_t>((clock::now() - origin) / tick);
+}
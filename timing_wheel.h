@@ -0,0 +1,83 @@
+#ifndef CM_TIMING_WHEEL_H
+#define CM_TIMING_WHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+
+namespace cm {
+
+    /**
+     * Hierarchical timing wheel: 4 levels of 64 slots, a level's slot spans a whole turn of the level
+     * below. Scheduling, cancelling and every tick cost O(1) no matter how many timers are pending,
+     * timers move to a lower level only when the turn reaching them begins. With a tick of a second
+     * the wheel covers ~194 days, later timers wait in the last level and are put back in on the way.
+     *
+     * One steady_timer drives the wheel while timers are pending. All calls and callbacks run on the
+     * strand given to the constructor.
+     */
+    class timing_wheel {
+
+    public:
+        typedef std::chrono::steady_clock clock;
+        typedef std::function<void()> callback_type;
+
+        struct entry {
+            std::uint64_t expires;
+            callback_type cb;
+            // fired or cancelled, slots drop it when they get to it
+            bool done = false;
+        };
+
+        typedef std::shared_ptr<entry> handle;
+
+        timing_wheel(const timing_wheel &) = delete;
+
+        timing_wheel(boost::asio::io_service::strand &strand, clock::duration tick);
+
+        /**
+         * Invokes cb after delay, rounded up to the next tick.
+         */
+        handle schedule(clock::duration delay, callback_type cb);
+
+        /**
+         * Does nothing if the timer already fired.
+         */
+        void cancel(const handle &h);
+
+        /**
+         * Cancels all timers.
+         */
+        void stop();
+
+    private:
+        static const int slot_bits = 6;
+        static const std::uint64_t slot_mask = (1 << slot_bits) - 1;
+        static const int levels = 4;
+
+        void insert(const handle &e);
+
+        void advance();
+
+        void start_ticking();
+
+        void tick_handler(const boost::system::error_code &ec);
+
+        [[nodiscard]] std::uint64_t elapsed_ticks() const;
+
+        boost::asio::io_service::strand &strand;
+        boost::asio::steady_timer timer;
+        clock::duration tick;
+        clock::time_point origin;
+        std::uint64_t now_tick = 0;
+        std::array<std::array<std::vector<handle>, slot_mask + 1>, levels> wheel;
+        std::size_t pending = 0;
+        bool ticking = false;
+    };
+}
+
+#endif //CM_TIMING_WHEEL_H
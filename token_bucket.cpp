@@ -0,0 +1,27 @@
+#include <algorithm>
+#include "token_bucket.h"
+
+cm::token_bucket::token_bucket(double rate, double burst)
+        : rate(rate), burst(burst), tokens(burst), last_refill(std::chrono::steady_clock::now()) {
+}
+
+bool cm::token_bucket::try_take() {
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - last_refill;
+    tokens = std::min(burst, tokens + elapsed.count() * rate);
+    last_refill = now;
+
+    if (tokens < 1) {
+        suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    tokens -= 1;
+    return true;
+}
+
+std::size_t cm::token_bucket::take_suppressed() {
+    return suppressed.exchange(0, std::memory_order_relaxed);
+}
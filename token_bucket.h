@@ -0,0 +1,40 @@
+#ifndef CM_TOKEN_BUCKET_H
+#define CM_TOKEN_BUCKET_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+namespace cm {
+
+    /**
+     * Allows rate events per second on average and bursts of up to burst events.
+     * Refused events are counted until they are collected with take_suppressed(). Shared by all starts
+     * of an app, a retired child still draining its output takes tokens next to its replacement.
+     */
+    class token_bucket {
+
+    public:
+        token_bucket(double rate, double burst);
+
+        /**
+         * Takes one token. Returns false and counts the event as suppressed if none is left.
+         */
+        bool try_take();
+
+        /**
+         * Returns the number of suppressed events since the last call.
+         */
+        std::size_t take_suppressed();
+
+    private:
+        const double rate, burst;
+        // guards tokens and last_refill
+        std::mutex mutex;
+        double tokens;
+        std::chrono::steady_clock::time_point last_refill;
+        std::atomic<std::size_t> suppressed{0};
+    };
+}
+
+#endif //CM_TOKEN_BUCKET_H
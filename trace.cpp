@@ -0,0 +1,137 @@
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "trace.h"
+#include "log_format.h"
+
+namespace {
+
+    struct event {
+        const char *name;
+        char phase;
+        int tid;
+        std::int64_t ts_ns, dur_ns;
+        std::uint8_t detail_len;
+        char detail[47];
+    };
+
+    std::unique_ptr<event[]> events;
+    std::size_t capacity = 0;
+    std::atomic_size_t next{0};
+    cm::trace::clock::time_point epoch;
+
+    int thread_id() {
+        thread_local int tid = static_cast<int>(::syscall(SYS_gettid));
+        return tid;
+    }
+
+    void record(const char *name, char phase, std::string_view detail,
+                cm::trace::clock::time_point begin, cm::trace::clock::time_point end) {
+        std::size_t i = next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= capacity)
+            return;
+
+        auto &e = events[i];
+        e.name = name;
+        e.phase = phase;
+        e.tid = thread_id();
+        e.ts_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(begin - epoch).count();
+        e.dur_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+        // a cut inside a multibyte character drops the character, the trace has to stay valid UTF-8
+        std::size_t len = std::min(detail.size(), sizeof(e.detail));
+        if (len < detail.size())
+            while (len > 0 && (static_cast<unsigned char>(detail[len]) & 0xC0) == 0x80)
+                len--;
+        e.detail_len = static_cast<std::uint8_t>(len);
+        std::memcpy(e.detail, detail.data(), e.detail_len);
+    }
+
+    // microseconds with nanosecond decimals, the unit of the trace event format
+    void append_us(std::string &out, std::int64_t ns) {
+        char buf[32];
+        std::snprintf(buf, sizeof(buf), "%lld.%03lld", static_cast<long long>(ns / 1000),
+                      static_cast<long long>(ns % 1000));
+        out.append(buf);
+    }
+}
+
+void cm::trace::enable(std::size_t size) {
+    events = std::make_unique<event[]>(size);
+    capacity = size;
+    epoch = clock::now();
+}
+
+bool cm::trace::enabled() {
+    return capacity > 0;
+}
+
+void cm::trace::complete(const char *name, std::string_view detail, clock::time_point begin, clock::time_point end) {
+    if (capacity > 0)
+        record(name, 'X', detail, begin, end);
+}
+
+void cm::trace::instant(const char *name, std::string_view detail) {
+    if (capacity > 0) {
+        auto now = clock::now();
+        record(name, 'i', detail, now, now);
+    }
+}
+
+bool cm::trace::write(const std::string &file) {
+
+    std::size_t count = std::min(next.load(), capacity);
+    std::size_t dropped = next.load() - count;
+
+    std::string out;
+    out.reserve(128 + count * 128);
+    out.append("{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":");
+    out.append(std::to_string(dropped));
+    out.append("},\"traceEvents\":[\n");
+    out.append("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":");
+    out.append(std::to_string(::getpid()));
+    out.append(",\"args\":{\"name\":\"cm\"}}");
+
+    for (std::size_t i = 0; i < count; i++) {
+        const auto &e = events[i];
+        out.append(",\n{\"name\":\"");
+        append_json_escaped(out, e.name);
+        out.append("\",\"ph\":\"");
+        out.push_back(e.phase);
+        out.append("\",\"pid\":");
+        out.append(std::to_string(::getpid()));
+        out.append(",\"tid\":");
+        out.append(std::to_string(e.tid));
+        out.append(",\"ts\":");
+        append_us(out, e.ts_ns);
+        if (e.phase == 'X') {
+            out.append(",\"dur\":");
+            append_us(out, e.dur_ns);
+        } else {
+            out.append(",\"s\":\"p\"");
+        }
+        if (e.detail_len > 0) {
+            out.append(",\"args\":{\"detail\":\"");
+            append_json_escaped(out, std::string_view(e.detail, e.detail_len));
+            out.append("\"}");
+        }
+        out.push_back('}');
+    }
+    out.append("\n]}\n");
+
+    std::ofstream os(file, std::ios::binary | std::ios::trunc);
+    os << out;
+    return static_cast<bool>(os.flush());
+}
+
+cm::trace::span::span(const char *name, std::string_view detail) : name(name), detail(detail) {
+    if (capacity > 0)
+        begin = clock::now();
+}
+
+cm::trace::span::~span() {
+    if (capacity > 0)
+        record(name, 'X', detail, begin, clock::now());
+}
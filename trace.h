@@ -0,0 +1,57 @@
+#ifndef CM_TRACE_H
+#define CM_TRACE_H
+
+#include <chrono>
+#include <string>
+#include <string_view>
+
+namespace cm::trace {
+
+    typedef std::chrono::steady_clock clock;
+
+    /**
+     * Starts recording into a buffer of capacity events, allocated up front. Has to be called
+     * before any other thread is started. Events beyond the capacity are dropped and counted.
+     */
+    void enable(std::size_t capacity);
+
+    bool enabled();
+
+    /**
+     * Records a span which already ended. detail is shown as argument of the event and truncated
+     * to a few dozen bytes, recording doesn't allocate. Can be called from any thread.
+     */
+    void complete(const char *name, std::string_view detail, clock::time_point begin, clock::time_point end);
+
+    /**
+     * Records a point in time.
+     */
+    void instant(const char *name, std::string_view detail);
+
+    /**
+     * Writes all events as Chrome trace event JSON, loadable by chrome://tracing and Perfetto.
+     * Must not race with recording. Returns false if file couldn't be written.
+     */
+    bool write(const std::string &file);
+
+    /**
+     * Records the time from its construction to its destruction, nothing if tracing is off.
+     * detail has to outlive the span.
+     */
+    class span {
+
+    public:
+        explicit span(const char *name, std::string_view detail = {});
+
+        span(const span &) = delete;
+
+        ~span();
+
+    private:
+        const char *name;
+        std::string_view detail;
+        clock::time_point begin;
+    };
+}
+
+#endif //CM_TRACE_H
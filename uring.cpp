@@ -0,0 +1,382 @@
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "uring.h"
+
+namespace {
+    // IORING_OP_READ_MULTISHOT (linux 6.7), not yet known to all kernel headers we build with
+    const std::uint8_t op_read_multishot = 49;
+
+    const unsigned buffers_per_stream = 4;
+    const std::size_t buffer_size = 16 * 1024;
+    const std::chrono::milliseconds backpressure_retry(10);
+
+    int uring_setup(unsigned entries, io_uring_params *p) {
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+    }
+
+    int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    int uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+        return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+    }
+
+    template<typename T>
+    T *at(void *base, std::uint32_t offset) {
+        return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+    }
+
+    [[noreturn]] void fail(const char *what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+}
+
+cm::uring::uring(boost::asio::io_service &ios, unsigned entries)
+        : events(ios) {
+
+    io_uring_params p{};
+    ring_fd = uring_setup(entries, &p);
+    if (ring_fd < 0)
+        fail("io_uring_setup");
+
+    try {
+        if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP)) {
+            errno = ENOSYS;
+            fail("io_uring features");
+        }
+
+        std::vector<char> probe_storage(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+        auto *probe = reinterpret_cast<io_uring_probe *>(probe_storage.data());
+        if (uring_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+            fail("io_uring probe");
+        if (probe->last_op < op_read_multishot || !(probe->ops[op_read_multishot].flags & IO_URING_OP_SUPPORTED)) {
+            errno = ENOSYS;
+            fail("io_uring multishot read");
+        }
+
+        sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        sq_size = cq_size = std::max(sq_size, cq_size);
+
+        sq_ptr = ::mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                        IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) {
+            sq_ptr = nullptr;
+            fail("io_uring mmap");
+        }
+        cq_ptr = sq_ptr;
+
+        sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+        void *sqes_ptr = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                                IORING_OFF_SQES);
+        if (sqes_ptr == MAP_FAILED)
+            fail("io_uring mmap");
+        sqes = static_cast<io_uring_sqe *>(sqes_ptr);
+
+        sq_tail = at<unsigned>(sq_ptr, p.sq_off.tail);
+        sq_mask = at<unsigned>(sq_ptr, p.sq_off.ring_mask);
+        sq_array = at<unsigned>(sq_ptr, p.sq_off.array);
+        sq_flags = at<unsigned>(sq_ptr, p.sq_off.flags);
+        cq_head = at<unsigned>(cq_ptr, p.cq_off.head);
+        cq_tail = at<unsigned>(cq_ptr, p.cq_off.tail);
+        cq_mask = at<unsigned>(cq_ptr, p.cq_off.ring_mask);
+        cqes = at<io_uring_cqe>(cq_ptr, p.cq_off.cqes);
+
+        event_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (event_fd < 0)
+            fail("eventfd");
+        if (uring_register(ring_fd, IORING_REGISTER_EVENTFD, &event_fd, 1) < 0)
+            fail("io_uring eventfd");
+
+        events.assign(event_fd);
+    } catch (...) {
+        if (sqes)
+            ::munmap(sqes, sqes_size);
+        if (sq_ptr)
+            ::munmap(sq_ptr, sq_size);
+        if (event_fd >= 0 && !events.is_open())
+            ::close(event_fd);
+        ::close(ring_fd);
+        throw;
+    }
+}
+
+cm::uring::~uring() {
+    events.close();
+    ::munmap(sqes, sqes_size);
+    ::munmap(sq_ptr, sq_size);
+    ::close(ring_fd);
+}
+
+io_uring_sqe *cm::uring::next_sqe() {
+    unsigned tail = *sq_tail;
+    unsigned index = tail & *sq_mask;
+    io_uring_sqe *sqe = &sqes[index];
+
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    return sqe;
+}
+
+void cm::uring::enter(unsigned count) {
+    while (uring_enter(ring_fd, count, 0, 0) < 0 && errno == EINTR);
+}
+
+void cm::uring::submit_read(uring_stream *stream, int fd, std::uint16_t group) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    io_uring_sqe *sqe = next_sqe();
+    sqe->opcode = op_read_multishot;
+    sqe->fd = fd;
+    sqe->off = static_cast<std::uint64_t>(-1);
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = group;
+    sqe->user_data = reinterpret_cast<std::uint64_t>(stream);
+    enter(1);
+
+    inflight++;
+    if (!waiting) {
+        waiting = true;
+        wait();
+    }
+}
+
+void cm::uring::cancel(uring_stream *stream) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // ends the multishot read with -ECANCELED, the cancel itself completes without user data
+    io_uring_sqe *sqe = next_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = reinterpret_cast<std::uint64_t>(stream);
+    enter(1);
+}
+
+void cm::uring::provide_buffers(std::uint16_t group, char *base, std::size_t size,
+                                const std::vector<std::uint16_t> &bids) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // completions of these carry no user data and are skipped when reaping
+    for (auto bid : bids) {
+        io_uring_sqe *sqe = next_sqe();
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = 1;
+        sqe->addr = reinterpret_cast<std::uint64_t>(base + bid * size);
+        sqe->len = size;
+        sqe->off = bid;
+        sqe->buf_group = group;
+    }
+    enter(bids.size());
+}
+
+std::uint16_t cm::uring::allocate_group() {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (free_groups.empty())
+        return next_group++;
+
+    std::uint16_t group = free_groups.back();
+    free_groups.pop_back();
+    return group;
+}
+
+void cm::uring::release_group(std::uint16_t group, unsigned count) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    io_uring_sqe *sqe = next_sqe();
+    sqe->opcode = IORING_OP_REMOVE_BUFFERS;
+    sqe->fd = count;
+    sqe->buf_group = group;
+    enter(1);
+
+    free_groups.push_back(group);
+}
+
+void cm::uring::wait() {
+    events.async_wait(boost::asio::posix::stream_descriptor::wait_read, [this](const boost::system::error_code &ec) {
+        if (!ec)
+            reap();
+    });
+}
+
+void cm::uring::reap() {
+
+    std::uint64_t counter;
+    while (::read(event_fd, &counter, sizeof(counter)) < 0 && errno == EINTR);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    while (true) {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+        for (; head != tail; head++) {
+            const io_uring_cqe &cqe = cqes[head & *cq_mask];
+            if (cqe.user_data == 0)
+                continue;
+            if (!(cqe.flags & IORING_CQE_F_MORE))
+                inflight--;
+            reinterpret_cast<uring_stream *>(cqe.user_data)->completed(cqe.res, cqe.flags);
+        }
+
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+        // completions which didn't fit into the ring are only moved over when entering the kernel
+        if (!(__atomic_load_n(sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW))
+            break;
+        uring_enter(ring_fd, 0, 0, IORING_ENTER_GETEVENTS);
+    }
+
+    if (inflight > 0)
+        wait();
+    else
+        waiting = false;
+}
+
+cm::uring_stream::uring_stream(uring &ring, int fd, boost::asio::io_service::strand &strand, line_buffer &lines,
+                               const line_buffer::line_callback_type &cb, stream_metrics &metrics)
+        : ring(ring), fd(fd), strand(strand), lines(lines), cb(cb), metrics(metrics), resume(strand.context()),
+          buffers(new char[buffers_per_stream * buffer_size]), group(ring.allocate_group()) {
+
+    for (std::uint16_t bid = 0; bid < buffers_per_stream; bid++)
+        consumed.push_back(bid);
+    recycle();
+}
+
+cm::uring_stream::~uring_stream() {
+    ring.release_group(group, buffers_per_stream);
+}
+
+void cm::uring_stream::start() {
+    arm();
+}
+
+void cm::uring_stream::stop() {
+    boost::asio::post(strand, [this]() {
+        if (closed || stopping)
+            return;
+        stopping = true;
+        if (armed)
+            ring.cancel(this);
+        else if (!paused)
+            process();
+    });
+}
+
+void cm::uring_stream::arm() {
+    armed = true;
+    ring.submit_read(this, fd, group);
+}
+
+void cm::uring_stream::recycle() {
+    if (consumed.empty())
+        return;
+
+    ring.provide_buffers(group, buffers.get(), buffer_size, consumed);
+    consumed.clear();
+}
+
+void cm::uring_stream::completed(int res, unsigned flags) {
+    boost::asio::post(strand, [this, res, flags]() { on_completion(res, flags); });
+}
+
+void cm::uring_stream::on_completion(int res, unsigned flags) {
+
+    if (!(flags & IORING_CQE_F_MORE))
+        armed = false;
+
+    if (res > 0)
+        metrics.read(res);
+
+    if (res > 0)
+        chunks.push_back({static_cast<std::uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT), static_cast<std::size_t>(res), 0});
+    else if (res == 0 || res != -ENOBUFS)
+        eof = true; // ENOBUFS: all buffers are still queued, rearmed once they are consumed
+
+    if (!paused)
+        process();
+}
+
+void cm::uring_stream::process() {
+
+    if (closed)
+        return;
+
+    paused = false;
+
+    bool go_on = lines.commit(0, cb);
+
+    while (go_on && !chunks.empty()) {
+        chunk &c = chunks.front();
+
+        while (go_on && c.offset < c.len) {
+            auto dst = lines.prepare();
+            std::size_t n = std::min(dst.size(), c.len - c.offset);
+            std::memcpy(dst.data(), buffers.get() + c.bid * buffer_size + c.offset, n);
+            c.offset += n;
+            go_on = lines.commit(n, cb);
+        }
+
+        if (c.offset == c.len) {
+            consumed.push_back(c.bid);
+            chunks.pop_front();
+        }
+    }
+
+    recycle();
+
+    if (!go_on) {
+        paused = true;
+        resume.expires_after(backpressure_retry);
+        resume.async_wait(boost::asio::bind_executor(strand, [this](const boost::system::error_code &) {
+            process();
+        }));
+        return;
+    }
+
+    // after a cancelled read the pipe may still hold data, after EOF this only flushes
+    if ((eof || stopping) && !armed) {
+        read_rest();
+        return;
+    }
+
+    if (eof)
+        return;
+
+    lines.release_if_empty();
+
+    if (!armed)
+        arm();
+}
+
+void cm::uring_stream::read_rest() {
+
+    // the pipe is blocking, only what is available is read
+    int available = 0;
+    while (::ioctl(fd, FIONREAD, &available) == 0 && available > 0) {
+        auto dst = lines.prepare();
+        ssize_t n = ::read(fd, dst.data(), std::min(dst.size(), static_cast<std::size_t>(available)));
+        if (n <= 0)
+            break;
+        metrics.read(n);
+        if (!lines.commit(n, cb))
+            while (!lines.commit(0, cb));
+    }
+
+    lines.flush(cb);
+    closed = true;
+}
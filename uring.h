@@ -0,0 +1,146 @@
+#ifndef CM_URING_H
+#define CM_URING_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/asio.hpp>
+#include "line_buffer.h"
+#include "metrics.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace cm {
+
+    class uring_stream;
+
+    /**
+     * Minimal io_uring instance for reading child pipes. Reads are submitted as multishot reads
+     * selecting from per-stream provided buffer groups, so a pipe is armed once and keeps producing
+     * completions until its buffers run out. Completions are signalled through an eventfd which is
+     * watched by the io_service like any other descriptor.
+     */
+    class uring {
+
+    public:
+        uring(const uring &) = delete;
+
+        /**
+         * Throws std::system_error if io_uring or multishot reads are not available.
+         */
+        explicit uring(boost::asio::io_service &ios, unsigned entries = 256);
+
+        ~uring();
+
+    private:
+        friend class uring_stream;
+
+        void submit_read(uring_stream *stream, int fd, std::uint16_t group);
+
+        void cancel(uring_stream *stream);
+
+        void provide_buffers(std::uint16_t group, char *base, std::size_t size, const std::vector<std::uint16_t> &bids);
+
+        std::uint16_t allocate_group();
+
+        void release_group(std::uint16_t group, unsigned count);
+
+        io_uring_sqe *next_sqe();
+
+        void enter(unsigned count);
+
+        void wait();
+
+        void reap();
+
+        int ring_fd = -1;
+        int event_fd = -1;
+        boost::asio::posix::stream_descriptor events;
+
+        void *sq_ptr = nullptr, *cq_ptr = nullptr;
+        std::size_t sq_size = 0, cq_size = 0, sqes_size = 0;
+        unsigned *sq_tail = nullptr, *sq_mask = nullptr, *sq_array = nullptr, *sq_flags = nullptr;
+        unsigned *cq_head = nullptr, *cq_tail = nullptr, *cq_mask = nullptr;
+        io_uring_sqe *sqes = nullptr;
+        io_uring_cqe *cqes = nullptr;
+
+        std::mutex mutex;
+        std::size_t inflight = 0;
+        bool waiting = false;
+        std::vector<std::uint16_t> free_groups;
+        std::uint16_t next_group = 0;
+    };
+
+    /**
+     * Reads one pipe through a uring and feeds it into a line_buffer. Handlers run on the
+     * given strand. A chunk stays in its ring buffer until all of its lines were accepted, so a
+     * consumer which refuses lines eventually runs the stream out of buffers and reading stops.
+     */
+    class uring_stream {
+
+    public:
+        uring_stream(const uring_stream &) = delete;
+
+        uring_stream(uring &ring, int fd, boost::asio::io_service::strand &strand, line_buffer &lines,
+                     const line_buffer::line_callback_type &cb, stream_metrics &metrics);
+
+        ~uring_stream();
+
+        void start();
+
+        /**
+         * Passes on what is readable right now and stops, without waiting for EOF.
+         */
+        void stop();
+
+        /**
+         * True once the pipe hit EOF and all of its lines were passed on. The ring doesn't refer to
+         * the stream anymore then.
+         */
+        [[nodiscard]] bool finished() const {
+            return closed.load();
+        }
+
+    private:
+        friend class uring;
+
+        struct chunk {
+            std::uint16_t bid;
+            std::size_t len, offset;
+        };
+
+        void completed(int res, unsigned flags);
+
+        void on_completion(int res, unsigned flags);
+
+        void process();
+
+        void recycle();
+
+        void read_rest();
+
+        void arm();
+
+        uring &ring;
+        int fd;
+        boost::asio::io_service::strand &strand;
+        line_buffer &lines;
+        const line_buffer::line_callback_type &cb;
+        stream_metrics &metrics;
+        boost::asio::steady_timer resume;
+
+        std::unique_ptr<char[]> buffers;
+        std::uint16_t group = 0;
+        std::vector<std::uint16_t> consumed;
+
+        std::deque<chunk> chunks;
+        bool armed = false, eof = false, paused = false, stopping = false;
+        std::atomic_bool closed{false};
+    };
+}
+
+#endif //CM_URING_H